@@ -0,0 +1,147 @@
+//***************************************************************************
+//* 								hal_ch579.c
+//*	Discription : CH579 backend of hal.h, the set up of the pins, UART1,
+//*				TMR2 and SPI0 and the SysTick time base. Everything else used
+//*				while running is a macro in hal.h.
+//***************************************************************************
+#include "hal.h"
+#include "progdef.h"
+#include "isp_uart.h"
+#include "icp_spi.h"
+
+//***************************************************************************
+//* time base
+//***************************************************************************
+volatile unsigned long hal_time_ms = 0;			// SysTick interrupts since hal_time_init()
+
+//***************************************************************************
+//* hal_pins_init()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : ICP pins as outputs with the target powered off, UART1
+//*				pins
+//***************************************************************************
+void hal_pins_init(void)
+{
+	/* GPIO for ICP */
+	GPIOA_ResetBits(ICP_VCC);
+	GPIOA_ModeCfg(ICP_VCC, GPIO_ModeOut_PP_20mA);
+	GPIOA_ModeCfg(ICP_RESET | ICP_PCL | ICP_PDA, GPIO_ModeOut_PP_5mA);
+
+	/* GPIO for UART */
+  GPIOA_SetBits(GPIO_Pin_9);
+  GPIOA_ModeCfg(GPIO_Pin_8, GPIO_ModeIN_PU);
+	GPIOA_ModeCfg(GPIO_Pin_9, GPIO_ModeOut_PP_5mA);
+}
+
+//***************************************************************************
+//* hal_uart_init()
+//* Input(s) : baudrate.
+//* Returns : none.
+//* Description : UART1 with receive and line status interrupts
+//***************************************************************************
+void hal_uart_init(unsigned long baudrate)
+{
+  UART1_DefInit();
+  UART1_BaudRateCfg(baudrate);
+  UART1_ByteTrigCfg(ISP_RX_TRIG);
+  UART1_INTCfg(ENABLE, RB_IER_RECV_RDY | RB_IER_LINE_STAT);
+  NVIC_SetPriority(UART1_IRQn, HAL_PRIO_UART);
+  NVIC_EnableIRQ(UART1_IRQn);
+}
+
+//***************************************************************************
+//* hal_poll_init()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : TMR2 interrupt for the background FMCON poll. Its bus
+//*				traffic takes tens of usec, so UART1 may preempt it
+//***************************************************************************
+void hal_poll_init(void)
+{
+  TMR2_ClearITFlag(TMR0_3_IT_CYC_END);
+  TMR2_ITCfg(ENABLE, TMR0_3_IT_CYC_END);
+  NVIC_SetPriority(TMR2_IRQn, HAL_PRIO_ICP);
+  NVIC_EnableIRQ(TMR2_IRQn);
+}
+
+//***************************************************************************
+//* hal_time_init()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : SysTick from Fsys with an interrupt every msec. Every
+//*				other interrupt has a lower priority, so SysTick preempts
+//*				them and the msec count is never behind the counter while
+//*				another handler runs
+//***************************************************************************
+void hal_time_init(void)
+{
+  SysTick_Config(FREQ_SYS / 1000);
+  NVIC_SetPriority(SysTick_IRQn, HAL_PRIO_TIME);
+}
+
+//***************************************************************************
+//* hal_time_us()
+//* Input(s) : none.
+//* Returns : usec since hal_time_init().
+//* Description : the msec count is read again when the counter wrapped
+//*				while it was read
+//***************************************************************************
+unsigned long hal_time_us(void)
+{
+  unsigned long ms;
+  unsigned long ticks;
+  do
+  {
+    ms = hal_time_ms;
+    ticks = SysTick->VAL;
+  } while(ms != hal_time_ms);
+  return ms * 1000 + (FREQ_SYS / 1000 - 1 - ticks) / (FREQ_SYS / 1000000);	// counts down from the reload value
+}
+
+//***************************************************************************
+//* SysTick_Handler()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : msec count of the time base
+//***************************************************************************
+void SysTick_Handler(void)
+{
+  hal_time_ms++;
+}
+
+#if ICP_SPI0
+//***************************************************************************
+//* hal_spi_init()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : SPI0 as the ICP master, mode 3 with the low bit first so
+//*				PCL idles high and the target takes PDA on the rising edge
+//***************************************************************************
+void hal_spi_init(void)
+{
+  GPIOA_ModeCfg(ICP_PCL | ICP_PDA, GPIO_ModeIN_Floating);	// bit-bang pins are not wired
+  GPIOA_SetBits(ICP_SPI_PCL | ICP_SPI_MOSI);
+  GPIOA_ModeCfg(ICP_SPI_PCL | ICP_SPI_MOSI, GPIO_ModeOut_PP_5mA);
+  GPIOA_ModeCfg(ICP_SPI_MISO, GPIO_ModeIN_Floating);
+  SPI0_MasterDefInit();
+  SPI0_DataMode(Mode3_LowBitINFront);
+  hal_spi_clock(ICP_SPI_CLKDIV);
+}
+
+//***************************************************************************
+//* hal_spi_clock()
+//* Input(s) : divider, PCL = Fsys / divider.
+//* Returns : none.
+//* Description : mode 3 samples MISO on the rising edge, but the target
+//*				only drives its result bit after that edge. The master
+//*				input delay moves the sample half a period later, to the
+//*				falling edge. SPI0_CLKCfg() clears it for every divider
+//*				but 2, so it is set again after every change
+//***************************************************************************
+void hal_spi_clock(unsigned char divider)
+{
+  SPI0_CLKCfg(divider);
+  R8_SPI0_CTRL_CFG |= RB_SPI_MST_DLY_EN;
+}
+#endif
@@ -0,0 +1,123 @@
+//***************************************************************************
+//* 								icp_spi.c 
+//*	Discription : ICP transport on the SPI0 block. The ICP wire protocol is
+//*				LSB first data on PDA, set while PCL is low and taken on
+//*				the rising edge, with PCL idling high, which is SPI mode 3
+//*				with the low bit in front. For reads MOSI is released and
+//*				the target drives PDA, which is sampled on MISO half a
+//*				period after the rising edge (see hal_spi_clock()).
+//*
+//***************************************************************************
+#include "hal.h"
+#include "progdef.h"
+#include "icp_spi.h"
+#include "icp_stats.h"
+
+#if ICP_SPI0
+
+extern unsigned char pda_output;				// PDA direction cache in main.c
+
+//***************************************************************************
+//* burst buffer
+//***************************************************************************
+unsigned char spi_burst[ICP_SPI_BURST];			// write-only bytes for one DMA transfer
+unsigned int spi_burst_length = 0;				// number of bytes in the burst
+
+//***************************************************************************
+//* icp_spi_init()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : set up SPI0 as the ICP master, PCL high and PDA driven
+//***************************************************************************
+void icp_spi_init(void)
+{
+  hal_spi_init();								// PCL idles high, data on rising edge
+  pda_output = 1;
+}
+
+//***************************************************************************
+//* shift_out()
+//* Input(s) : data_byte.
+//* Returns : none.
+//* Description : function to shift out data to the part being programmed
+//***************************************************************************
+void shift_out(char data_byte)
+{
+  if(!pda_output)								// take PDA back from the target
+  {
+    HAL_SPI_MOSI_DRIVE();
+    pda_output = 1;
+    ICP_STAT_TURN();
+  }
+  ICP_STAT_OUT();
+  HAL_SPI_SEND(data_byte);
+}
+
+//***************************************************************************
+//* shift_in()
+//* Input(s) : none.
+//* Returns : Data shifted back from part that is being programmed.
+//* Description : function read data from the part being programmed
+//***************************************************************************
+char shift_in(void)
+{
+  if(pda_output)								// release PDA to the target
+  {
+    HAL_SPI_MOSI_RELEASE();
+    pda_output = 0;
+    ICP_STAT_TURN();
+  }
+  ICP_STAT_IN();
+  return HAL_SPI_RECV();						// clocks 8 bits, data comes in on MISO
+}
+
+//***************************************************************************
+//* icp_spi_burst_begin()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : start collecting a write-only burst
+//***************************************************************************
+void icp_spi_burst_begin(void)
+{
+  spi_burst_length = 0;
+}
+
+//***************************************************************************
+//* icp_spi_burst_byte()
+//* Input(s) : data_byte.
+//* Returns : none.
+//* Description : add a byte to the burst
+//***************************************************************************
+void icp_spi_burst_byte(unsigned char data_byte)
+{
+  if(spi_burst_length == ICP_SPI_BURST)			// burst too long, send what we have
+  {
+    icp_spi_burst_end();
+  }
+  ICP_STAT_OUT();
+  spi_burst[spi_burst_length++] = data_byte;
+}
+
+//***************************************************************************
+//* icp_spi_burst_end()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : clock the burst out back to back with SPI0 DMA
+//***************************************************************************
+void icp_spi_burst_end(void)
+{
+  if(spi_burst_length == 0)
+  {
+    return;
+  }
+  if(!pda_output)								// take PDA back from the target
+  {
+    HAL_SPI_MOSI_DRIVE();
+    pda_output = 1;
+    ICP_STAT_TURN();
+  }
+  HAL_SPI_BURST(spi_burst, spi_burst_length);
+  spi_burst_length = 0;
+}
+
+#endif
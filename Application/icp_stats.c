@@ -0,0 +1,99 @@
+//***************************************************************************
+//* 								icp_stats.c
+//*	Discription : ICP bus counters per operation. The transports count
+//*				edges, PDA turnarounds and opcodes with the macros in
+//*				icp_stats.h, the TMR2 handler counts the FMCON polls.
+//*				MISC_READ sub-function MISC_ICP_STATS sends the table, one
+//*				hex record per operation with the operation number as the
+//*				address and the five counters, MSB first, as the data. In
+//*				binary mode the records are the data of the reply frame
+//*				without the framing.
+//*
+//***************************************************************************
+#include "hal.h"
+#include "progdef.h"
+#include "isp_uart.h"
+#include "isp_binary.h"
+#include "icp_stats.h"
+
+//***************************************************************************
+//* counters
+//***************************************************************************
+icp_stat icp_stats[ICP_OPS];					// since reset or the last clear
+unsigned char icp_op = ICP_OP_OTHER;			// operation the bus traffic goes to
+unsigned char icp_stat_data = 0;				// next byte out is the data of an opcode
+
+//***************************************************************************
+//* icp_stats_clear()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : start a new session
+//***************************************************************************
+void icp_stats_clear(void)
+{
+  unsigned char op;
+  for(op = 0; op < ICP_OPS; op++)
+  {
+    icp_stats[op].calls = 0;
+    icp_stats[op].edges = 0;
+    icp_stats[op].turnarounds = 0;
+    icp_stats[op].opcodes = 0;
+    icp_stats[op].polls = 0;
+  }
+}
+
+//***************************************************************************
+//* stats_long()
+//* Input(s) : value, sum, running checksum of the record.
+//* Returns : none.
+//* Description : add a counter to the reply, MSB first
+//***************************************************************************
+static void stats_long(unsigned long value, unsigned char *sum)
+{
+  signed char shift;
+  for(shift = 24; shift >= 0; shift -= 8)
+  {
+    *sum += (unsigned char)(value >> shift);
+    isp_reply_hex(value >> shift);
+  }
+}
+
+//***************************************************************************
+//* icp_stats_report()
+//* Input(s) : clear, 1 to start a new session after the report.
+//* Returns : none.
+//* Description : send the table and the ok message
+//***************************************************************************
+void icp_stats_report(unsigned char clear)
+{
+  unsigned char op;
+  unsigned char sum;
+  for(op = 0; op < ICP_OPS; op++)
+  {
+    sum = 5 * 4 + op;							// length and address low
+    if(!isp_binary)								// data record header
+    {
+      isp_reply_char(':');
+      isp_reply_hex(5 * 4);
+      isp_reply_hex(0x00);
+      isp_reply_hex(op);
+      isp_reply_hex(0x00);
+    }
+    stats_long(icp_stats[op].calls, &sum);
+    stats_long(icp_stats[op].edges, &sum);
+    stats_long(icp_stats[op].turnarounds, &sum);
+    stats_long(icp_stats[op].opcodes, &sum);
+    stats_long(icp_stats[op].polls, &sum);
+    if(!isp_binary)
+    {
+      isp_reply_hex(-sum);						// two's complement checksum
+      isp_reply_char('\r');
+      isp_reply_char('\n');
+    }
+  }
+  if(clear)
+  {
+    icp_stats_clear();
+  }
+  isp_reply('.');								// send ok message
+}
@@ -0,0 +1,196 @@
+//***************************************************************************
+//* 								hal.h
+//*	Discription : hardware abstraction for the GPIO, UART1, TMR2, SysTick,
+//*				SPI0 and delay calls of the bridge. On the CH579 the macros map straight
+//*				onto the registers and the peripheral driver, so the code
+//*				is the same as before. With HAL_HOST set they call the host
+//*				backend in Host/hal_host.c, which wires PCL/PDA, VCC and
+//*				RESET to the LPC900 model and UART1 to a pipe or a pseudo
+//*				terminal, so the whole bridge runs as a Linux process.
+//*
+//*				Spin loops waiting for an interrupt call HAL_IDLE(), on
+//*				the host that is where time moves on and the interrupt
+//*				handlers are run. Timed loops waiting for the host use
+//*				HAL_WAIT_US() instead of HAL_DELAY_US().
+//***************************************************************************
+#ifndef __HAL_H__
+#define __HAL_H__
+
+#ifndef HAL_HOST
+#define HAL_HOST		0			// 1 to build for the host backend
+#endif
+
+#if !HAL_HOST
+#include "CH57x_common.h"
+
+//***************************************************************************
+//* GPIO, pins are masks in port A
+//***************************************************************************
+#define HAL_PIN_SET(pins)		GPIOA_SetBits(pins)
+#define HAL_PIN_CLEAR(pins)		GPIOA_ResetBits(pins)
+#define HAL_PORT_LEVELS()		ICP_PORT_OUT			// output latch of PA[7:0]
+#define HAL_PORT_WRITE(value)	ICP_PORT_OUT = (value)
+#define HAL_PORT_READ()			ICP_PORT_PIN			// pin levels of PA[7:0]
+#define HAL_PDA_DRIVE()			ICP_PORT_DIR |= (unsigned char)ICP_PDA
+#define HAL_PDA_RELEASE()		ICP_PORT_DIR &= (unsigned char)~ICP_PDA
+#define HAL_NOP()				__NOP()
+
+//***************************************************************************
+//* Delays and idle
+//***************************************************************************
+#define HAL_DELAY_US(t)			DelayUs(t)
+#define HAL_DELAY_MS(t)			DelayMs(t)
+#define HAL_WAIT_US(t)			DelayUs(t)			// waiting for the host
+#define HAL_IDLE()									// interrupts run by themselves
+#define HAL_TIME_US()			hal_time_us()		// SysTick based, wraps after 71 minutes
+
+//***************************************************************************
+//* Interrupt priorities, lower is served first and preempts higher
+//***************************************************************************
+#define HAL_PRIO_TIME			0					// SysTick, the msec count keeps up in any handler
+#define HAL_PRIO_UART			1					// UART1 and TMR0, the FIFO must not overrun
+#define HAL_PRIO_ICP			2					// TMR2 poll, it uses the ICP bus
+
+//***************************************************************************
+//* TMR2, background FMCON poll
+//***************************************************************************
+#define HAL_POLL_START(cycles)	TMR2_TimerInit(cycles)
+#define HAL_POLL_RELOAD(cycles)	R32_TMR2_CNT_END = (cycles)
+#define HAL_POLL_STOP()			TMR2_Disable()
+#define HAL_POLL_ACK()			TMR2_ClearITFlag(TMR0_3_IT_CYC_END)
+
+//***************************************************************************
+//* UART1, ISP link
+//***************************************************************************
+#define HAL_UART_FLAG()			UART1_GetITFlag()
+#define HAL_UART_LINE()			UART1_GetLinSTA()
+#define HAL_UART_RX_LEVEL()		R8_UART1_RFC
+#define HAL_UART_RX_BYTE()		R8_UART1_RBR
+#define HAL_UART_TX_LEVEL()		R8_UART1_TFC
+#define HAL_UART_TX_BYTE(value)	R8_UART1_THR = (value)
+#define HAL_UART_TX_IRQ_ON()	R8_UART1_IER |= RB_IER_THR_EMPTY
+#define HAL_UART_TX_IRQ_OFF()	R8_UART1_IER &= ~RB_IER_THR_EMPTY
+#define HAL_UART_TX_EMPTY()		(R8_UART1_LSR & RB_LSR_TX_ALL_EMP)
+#define HAL_UART_IRQ_DISABLE()	NVIC_DisableIRQ(UART1_IRQn)
+#define HAL_UART_IRQ_ENABLE()	NVIC_EnableIRQ(UART1_IRQn)
+#define HAL_UART_DIVISOR		R16_UART1_DL
+#define HAL_UART_BAUD(baudrate, maxerr)	UART1_BaudRateCfgErr(baudrate, maxerr)
+
+//***************************************************************************
+//* SPI0, ICP transport of the SPI0 wiring variant, pins in icp_spi.h
+//***************************************************************************
+#define HAL_SPI_SEND(value)		SPI0_MasterSendByte(value)
+#define HAL_SPI_RECV()			SPI0_MasterRecvByte()
+#define HAL_SPI_BURST(data, length)	SPI0_MasterDMATrans(data, length)
+#define HAL_SPI_MOSI_DRIVE()	(R32_PA_DIR |= ICP_SPI_MOSI, R8_SPI0_CTRL_MOD |= RB_SPI_MOSI_OE)
+#define HAL_SPI_MOSI_RELEASE()	(R8_SPI0_CTRL_MOD &= ~RB_SPI_MOSI_OE, R32_PA_DIR &= ~ICP_SPI_MOSI)
+
+#else
+//***************************************************************************
+//* Host stand-ins for the CH579 names the application uses
+//***************************************************************************
+#define FREQ_SYS		32000000
+#define GPIO_Pin_2		(0x00000004)
+#define GPIO_Pin_3		(0x00000008)
+#define GPIO_Pin_4		(0x00000010)
+#define GPIO_Pin_5		(0x00000020)
+#define GPIO_Pin_8		(0x00000100)
+#define GPIO_Pin_9		(0x00000200)
+#define UART_FIFO_SIZE	8
+#define UART_II_LINE_STAT 0x06
+#define UART_II_RECV_RDY 0x04
+#define UART_II_RECV_TOUT 0x0C
+#define UART_II_THR_EMPTY 0x02
+#define UART_II_NO_INTER 0x01
+#define RB_LSR_OVER_ERR	0x02
+#define RB_LSR_PAR_ERR	0x04
+#define RB_LSR_FRAME_ERR 0x08
+#define RB_LSR_BREAK_ERR 0x10
+
+//***************************************************************************
+//* Cortex-M0 cycles charged for the port accesses of the bit kernels
+//***************************************************************************
+#define HAL_STORE_CYCLES 3			// port store with the bit arithmetic before it
+#define HAL_LOAD_CYCLES	2			// port load
+#define HAL_LOOP_CYCLES	4			// one ICP_DELAY() loop
+
+#define HAL_PIN_SET(pins)		hal_pin_set(pins)
+#define HAL_PIN_CLEAR(pins)		hal_pin_clear(pins)
+#define HAL_PORT_LEVELS()		hal_port_levels()
+#define HAL_PORT_WRITE(value)	hal_port_write(value)
+#define HAL_PORT_READ()			hal_port_read()
+#define HAL_PDA_DRIVE()			hal_pda_drive(1)
+#define HAL_PDA_RELEASE()		hal_pda_drive(0)
+#define HAL_NOP()				hal_cycles(HAL_LOOP_CYCLES)
+
+#define HAL_DELAY_US(t)			hal_delay_us(t)
+#define HAL_DELAY_MS(t)			hal_delay_us((t) * 1000UL)
+#define HAL_WAIT_US(t)			hal_wait_us(t)
+#define HAL_IDLE()				hal_idle()
+#define HAL_TIME_US()			hal_time_us()
+
+#define HAL_POLL_START(cycles)	hal_poll_start(cycles)
+#define HAL_POLL_RELOAD(cycles)	hal_poll_reload(cycles)
+#define HAL_POLL_STOP()			hal_poll_stop()
+#define HAL_POLL_ACK()
+
+#define HAL_UART_FLAG()			hal_uart_flag()
+#define HAL_UART_LINE()			hal_uart_line()
+#define HAL_UART_RX_LEVEL()		hal_uart_rx_level()
+#define HAL_UART_RX_BYTE()		hal_uart_rx_byte()
+#define HAL_UART_TX_LEVEL()		0						// FIFO never fills
+#define HAL_UART_TX_BYTE(value)	hal_uart_tx_byte(value)
+#define HAL_UART_TX_IRQ_ON()	hal_uart_tx_irq(1)
+#define HAL_UART_TX_IRQ_OFF()	hal_uart_tx_irq(0)
+#define HAL_UART_TX_EMPTY()		hal_uart_tx_empty()
+#define HAL_UART_IRQ_DISABLE()							// handlers never preempt
+#define HAL_UART_IRQ_ENABLE()
+#define HAL_UART_DIVISOR		hal_uart_divisor
+#define HAL_UART_BAUD(baudrate, maxerr)	hal_uart_baud(baudrate, maxerr)
+
+#define HAL_SPI_SEND(value)		hal_spi_send(value)
+#define HAL_SPI_RECV()			hal_spi_recv()
+#define HAL_SPI_BURST(data, length)	hal_spi_burst(data, length)
+#define HAL_SPI_MOSI_DRIVE()	hal_pda_drive(1)		// MOSI and MISO are both PDA
+#define HAL_SPI_MOSI_RELEASE()	hal_pda_drive(0)
+
+void hal_pin_set(unsigned long pins);
+void hal_pin_clear(unsigned long pins);
+unsigned char hal_port_levels(void);
+void hal_port_write(unsigned char value);
+unsigned char hal_port_read(void);
+void hal_pda_drive(unsigned char on);
+void hal_cycles(unsigned long cycles);
+void hal_delay_us(unsigned long t);
+void hal_wait_us(unsigned long t);
+void hal_idle(void);
+void hal_poll_start(unsigned long cycles);
+void hal_poll_reload(unsigned long cycles);
+void hal_poll_stop(void);
+unsigned char hal_uart_flag(void);
+unsigned char hal_uart_line(void);
+unsigned char hal_uart_rx_level(void);
+unsigned char hal_uart_rx_byte(void);
+void hal_uart_tx_byte(unsigned char value);
+void hal_uart_tx_irq(unsigned char on);
+unsigned char hal_uart_tx_empty(void);
+short hal_uart_baud(unsigned long baudrate, unsigned short maxerr);
+void hal_spi_send(unsigned char value);
+unsigned char hal_spi_recv(void);
+void hal_spi_burst(unsigned char *data, unsigned short length);
+
+extern unsigned short hal_uart_divisor;			// UART1 divisor, Fsys / 8 / baud
+#endif
+
+//***************************************************************************
+//* Set up, in hal_ch579.c or Host/hal_host.c
+//***************************************************************************
+void hal_pins_init(void);
+void hal_uart_init(unsigned long baudrate);
+void hal_poll_init(void);
+void hal_time_init(void);
+unsigned long hal_time_us(void);
+void hal_spi_init(void);
+void hal_spi_clock(unsigned char divider);
+
+#endif
@@ -0,0 +1,31 @@
+//***************************************************************************
+//* 								icp_spi.h 
+//*	Discription : SPI0 clocked ICP transport
+//***************************************************************************
+#ifndef __ICP_SPI_H__
+#define __ICP_SPI_H__
+
+//***************************************************************************
+//* Pin Definitions for the SPI0 wiring variant
+//* PCL is driven by SCK0, PDA by MOSI through a 1k resistor and read back
+//* directly on MISO, the resistor keeps a turnaround glitch harmless
+//***************************************************************************
+#define ICP_SPI_PCL		GPIO_Pin_13	// SCK0 to P0.5(PCL)
+#define ICP_SPI_MOSI	GPIO_Pin_14	// MOSI to P0.4(PDA) through 1k
+#define ICP_SPI_MISO	GPIO_Pin_15	// MISO to P0.4(PDA)
+
+//***************************************************************************
+//* SPI0 settings
+//***************************************************************************
+#define ICP_SPI_CLKDIV	ICP_CLOCK_DEFAULT	// SPI0_CLKCfg divider until calibrated
+#define ICP_SPI_BURST	160			// bytes in a DMA burst, fits a page burst
+
+//***************************************************************************
+//* Functions
+//***************************************************************************
+void icp_spi_init(void);
+void icp_spi_burst_begin(void);
+void icp_spi_burst_byte(unsigned char data_byte);
+void icp_spi_burst_end(void);
+
+#endif
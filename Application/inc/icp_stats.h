@@ -0,0 +1,71 @@
+//***************************************************************************
+//* 								icp_stats.h
+//*	Discription : ICP bus counters per operation, kept in RAM and read
+//*				back with MISC_READ sub-function MISC_ICP_STATS
+//***************************************************************************
+#ifndef __ICP_STATS_H__
+#define __ICP_STATS_H__
+
+#ifndef ICP_STATS
+#define ICP_STATS		1			// 0 leaves the counting out of the bit kernels
+#endif
+
+//***************************************************************************
+//* Operations the bus traffic is charged to, the FMCON polls of a flash
+//* command go to the operation that started it
+//***************************************************************************
+#define ICP_OP_OTHER	0			// calibration and anything not below
+#define ICP_OP_PROGRAM	1			// program(), one byte
+#define ICP_OP_PAGE		2			// program_page(), a page or part of one
+#define ICP_OP_ERASE_G	3			// erase_global()
+#define ICP_OP_ERASE_S	4			// erase_sector()
+#define ICP_OP_ERASE_P	5			// erase_page()
+#define ICP_OP_CRC_G	6			// crc_global()
+#define ICP_OP_CRC_S	7			// crc_sector()
+#define ICP_OP_CONFIG	8			// read_config(), write_config()
+#define ICP_OP_READ		9			// read_flash()
+#define ICP_OP_BLANK	10			// blank_check()
+#define ICP_OPS			11
+
+//***************************************************************************
+//* Counters of one operation
+//***************************************************************************
+typedef struct
+{
+  unsigned long calls;						// times the operation was started
+  unsigned long edges;						// PCL rising edges
+  unsigned long turnarounds;				// PDA direction changes
+  unsigned long opcodes;					// commands, an opcode and its data byte
+  unsigned long polls;						// FMCON reads of the background poll
+} icp_stat;
+
+extern icp_stat icp_stats[ICP_OPS];
+extern unsigned char icp_op;
+extern unsigned char icp_stat_data;
+
+//***************************************************************************
+//* Counting, each transport calls these once per byte or turnaround. A
+//* shift_in() is always the data byte of a read opcode, so it puts the
+//* opcode count back in step
+//***************************************************************************
+#if ICP_STATS
+#define ICP_STAT_OP(op)	do { icp_op = (op); icp_stats[op].calls++; } while(0)
+#define ICP_STAT_OUT()	do { icp_stats[icp_op].edges += 8; icp_stats[icp_op].opcodes += !icp_stat_data; icp_stat_data ^= 1; } while(0)
+#define ICP_STAT_IN()	do { icp_stats[icp_op].edges += 8; icp_stat_data = 0; } while(0)
+#define ICP_STAT_TURN()	icp_stats[icp_op].turnarounds++
+#define ICP_STAT_POLL()	icp_stats[icp_op].polls++
+#else
+#define ICP_STAT_OP(op)
+#define ICP_STAT_OUT()
+#define ICP_STAT_IN()
+#define ICP_STAT_TURN()
+#define ICP_STAT_POLL()
+#endif
+
+//***************************************************************************
+//* Functions
+//***************************************************************************
+void icp_stats_clear(void);
+void icp_stats_report(unsigned char clear);
+
+#endif
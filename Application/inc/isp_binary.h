@@ -0,0 +1,33 @@
+//***************************************************************************
+//* 								isp_binary.h
+//*	Discription : binary framed ISP protocol, switched on with MISC_WRITE
+//*				sub-function MISC_BINARY for hosts that don't need hex
+//***************************************************************************
+#ifndef __ISP_BINARY_H__
+#define __ISP_BINARY_H__
+
+//***************************************************************************
+//* Frame settings
+//* host   : BIN_SOF, length L/H, record type, address H/L, data, CRC H/L
+//* bridge : BIN_REPLY, status, length L/H, data, CRC H/L
+//* CRC-16/CCITT (0x1021, start 0xFFFF) over everything after the first byte
+//***************************************************************************
+#define BIN_SOF			0xA5		// start of a host frame
+#define BIN_REPLY		0x5A		// start of a reply frame
+#define BIN_FRAME_SIZE	1024		// largest data field
+#define BIN_CRC_START	0xFFFF		// CRC preset
+#define BIN_TIMEOUT		1000		// 10 usec units of silence inside a frame
+
+//***************************************************************************
+//* Functions
+//***************************************************************************
+void bin_service(void);
+unsigned char bin_receive_frame(void);
+void bin_dispatch(void);
+unsigned short bin_crc_update(unsigned short crc, unsigned char value);
+void bin_reply_byte(unsigned char value);
+void bin_reply(unsigned char status);
+
+extern unsigned char isp_binary;				// 1 when frames replace hex records
+
+#endif
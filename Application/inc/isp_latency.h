@@ -0,0 +1,85 @@
+//***************************************************************************
+//* 								isp_latency.h
+//*	Discription : latency histograms per ISP record type and per ICP
+//*				operation, read back with MISC_READ sub-function
+//*				MISC_LATENCY
+//***************************************************************************
+#ifndef __ISP_LATENCY_H__
+#define __ISP_LATENCY_H__
+
+#include "icp_stats.h"
+
+#ifndef ISP_LATENCY
+#define ISP_LATENCY		1			// 0 leaves the time stamps out
+#endif
+
+//***************************************************************************
+//* Buckets, bucket 0 counts times under LAT_UNIT usec, bucket b from
+//* LAT_UNIT << (b - 1) up to twice that, the last one everything longer
+//***************************************************************************
+#define LAT_BUCKETS		16
+#define LAT_UNIT_SHIFT	3			// LAT_UNIT is 8 usec, the last bucket starts at 131 msec
+
+//***************************************************************************
+//* Histograms, for every record type up to BLANK_CHECK four phases and
+//* for every ICP operation two
+//***************************************************************************
+#define LAT_TYPES		(BLANK_CHECK + 1)
+#define LAT_RECEIVE		0			// first to last character of the record
+#define LAT_ICP			1			// carrying it out, less the busy wait
+#define LAT_BUSY		2			// waiting for the target to finish a flash command
+#define LAT_REPLY		3			// end of the record to the status of its reply
+#define LAT_PHASES		4
+#define LAT_OP_ICP		0			// start of the operation to its flash command
+#define LAT_OP_BUSY		1			// flash command to FMCON reading done
+#define LAT_OP_PHASES	2
+#define LAT_RECORD(type, phase)	((type) * LAT_PHASES + (phase))
+#define LAT_OP(op, phase)		(LAT_TYPES * LAT_PHASES + (op) * LAT_OP_PHASES + (phase))
+#define LAT_HISTS		(LAT_TYPES * LAT_PHASES + ICP_OPS * LAT_OP_PHASES)
+
+extern unsigned short latency_hist[LAT_HISTS][LAT_BUCKETS];
+
+//***************************************************************************
+//* Hooks, empty without ISP_LATENCY
+//***************************************************************************
+#if ISP_LATENCY
+#define LAT_NOW()				HAL_TIME_US()
+#define LAT_RECEIVED(type, start)	latency_received(type, start)
+#define LAT_RECORD_BEGIN(type, received)	latency_record_begin(type, received)
+#define LAT_RECORD_END()		latency_record_end()
+#define LAT_BUSY_WAIT(start)	latency_busy_wait(start)
+#define LAT_REPLY_SENT()		latency_reply()
+#define LAT_OP_BEGIN(op)		latency_op_begin(op)
+#define LAT_OP_END()			latency_op_end()
+#define LAT_FLASH_START()		latency_flash_start()
+#define LAT_FLASH_DONE()		latency_flash_done()
+#else
+#define LAT_NOW()				0
+#define LAT_RECEIVED(type, start)	((void)(start), 0)
+#define LAT_RECORD_BEGIN(type, received)
+#define LAT_RECORD_END()
+#define LAT_BUSY_WAIT(start)	(void)(start)
+#define LAT_REPLY_SENT()
+#define LAT_OP_BEGIN(op)
+#define LAT_OP_END()
+#define LAT_FLASH_START()
+#define LAT_FLASH_DONE()
+#endif
+
+//***************************************************************************
+//* Functions
+//***************************************************************************
+void latency_add(unsigned char hist, unsigned long usec);
+unsigned long latency_received(unsigned char type, unsigned long start);
+void latency_record_begin(unsigned char type, unsigned long received);
+void latency_record_end(void);
+void latency_busy_wait(unsigned long start);
+void latency_reply(void);
+void latency_op_begin(unsigned char op);
+void latency_op_end(void);
+void latency_flash_start(void);
+void latency_flash_done(void);
+void latency_clear(void);
+void latency_report(unsigned char clear, unsigned char first);
+
+#endif
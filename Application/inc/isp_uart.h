@@ -0,0 +1,48 @@
+//***************************************************************************
+//* 								isp_uart.h
+//*	Discription : interrupt driven UART1 for the ISP link, received and
+//*				transmitted characters pass through ring buffers
+//***************************************************************************
+#ifndef __ISP_UART_H__
+#define __ISP_UART_H__
+
+//***************************************************************************
+//* Buffer settings, sizes must be a power of 2
+//***************************************************************************
+#define ISP_RX_SIZE		8192		// holds 58 hex records of ICP_PAGE_SIZE data bytes or 7 full frames
+#define ISP_TX_SIZE		512			// replies, the writer waits when it is full
+#define ISP_RX_TRIG		UART_7BYTE_TRIG	// FIFO level for the receive interrupt
+#define ISP_REPLY_SIZE	32			// reply buffer, longer replies are queued in parts
+
+//***************************************************************************
+//* Autobaud, RXD1 (PA8) must be wired to CAP0_ on PB19, the TMR0 capture
+//* pin on PA3 is taken by the target RESET
+//***************************************************************************
+#define ISP_CAP_PIN		GPIO_Pin_19	// CAP0_ on port B
+#define ISP_CAP_MASK	0x01FFFFFF	// width in a capture entry, bit 25 is the level
+#define ISP_CAP_TIMEOUT	(FREQ_SYS / 100)	// longest width measured, 3 bits at 300 baud
+#define ISP_AUTOBAUD_TICK (FREQ_SYS / 10)	// idle check every 100 msec
+
+//***************************************************************************
+//* Functions
+//***************************************************************************
+void isp_uart_init(unsigned long baudrate);
+unsigned int isp_uart_rx_count(void);
+unsigned char isp_uart_getc(void);
+unsigned char isp_uart_peek(void);
+void isp_uart_rx_flush(void);
+void isp_uart_putc(unsigned char ch);
+void isp_uart_write(const unsigned char *buffer, unsigned int length);
+unsigned char isp_uart_tx_idle(void);
+void isp_reply_char(unsigned char ch);
+void isp_reply_hex(unsigned char value);
+void isp_reply(unsigned char status);
+unsigned char isp_window_credits(void);
+void isp_autobaud_init(void);
+void isp_autobaud_arm(void);
+
+extern volatile unsigned char isp_uart_status;	// line errors seen, RB_LSR_ bits
+extern unsigned char isp_window;				// replies carry sequence and credits
+extern unsigned char isp_reply_sequence;		// sequence number of the record replied to
+
+#endif
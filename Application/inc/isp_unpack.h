@@ -0,0 +1,32 @@
+//***************************************************************************
+//* 								isp_unpack.h
+//*	Discription : decoder for COMPRESSED records, RLE fills and LZ copies
+//*				from a small window are written into the page buffer
+//***************************************************************************
+#ifndef __ISP_UNPACK_H__
+#define __ISP_UNPACK_H__
+
+//***************************************************************************
+//* Stream format, a token byte followed by its operands
+//* 0x00-0x7F : (t & 0x7F) + 1 literal bytes follow
+//* 0x80-0xBF : (t & 0x3F) + 3 copies of the byte that follows
+//* 0xC0-0xFF : (t & 0x3F) + 3 bytes copied from d + 1 bytes back, d follows
+//***************************************************************************
+#define UNPACK_RUN		0x80		// first run token
+#define UNPACK_COPY		0xC0		// first copy token
+#define UNPACK_MIN		3			// shortest run or copy
+#define UNPACK_WINDOW	256			// bytes of output kept for copies
+
+//***************************************************************************
+//* Retries, a record refused with R has output nothing and left the window
+//* as it was, so the host resends it corrected at the same address. A
+//* record at any other address starts without a window, its first copy
+//* token can only reach back into that same record
+//***************************************************************************
+
+//***************************************************************************
+//* Functions
+//***************************************************************************
+unsigned char unpack_record(unsigned int address, unsigned char *data, unsigned int length);
+
+#endif
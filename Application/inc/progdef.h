@@ -1,97 +1,236 @@
-//***************************************************************************
-//* 								progdef.h 
-//*	By : Bauke Siderius		
-//*	Discription : defenitions for programming commands for the LPC90x 
-//***************************************************************************
-
-//***************************************************************************
-//* Pin Definitions
-//***************************************************************************
-//#define ICP_PORT		GPIOA				// define GPIO port for ICP
-#define ICP_VCC			GPIO_Pin_2	// define VCC control pin
-#define ICP_RESET		GPIO_Pin_3	// define RESET control pin
-#define ICP_PCL			GPIO_Pin_4	// define PCL pin
-#define ICP_PDA			GPIO_Pin_5	// define PDA pin
-
-//***************************************************************************
-//* Programmer Opcodes
-//***************************************************************************
-#define NOP				0x00		// No operation
-#define WR_FMADRL		0x08		// Write address low
-#define RD_FMADRL		0x09		// Read address low 
-#define WR_FMADRH		0x0A		// Write address high
-#define RD_FMADRH		0x0B		// Read address low
-#define WR_FMCON		0x0E		// Write a command to FMCON
-#define RD_FMCON		0x0F		// Read a command from FMCON
-#define WR_FMDATA_PG	0x14		// Write a command to FMDATA and inc addr
-#define RD_FMDATA_PG	0x15		// Read a coomand from FMDATA and inc addr
-#define WR_FMDATA		0x0C		// Write a data byte to FMDATA
-#define RD_FMDATA		0x0D		// Read a data byte from FMDATA
-#define WR_FMDATA_I		0x04		// Write a data byte to FMDATA and increment
-#define RD_FMDATA_I		0x05		// Read a data byte from FMDATA and increment
-#define CLR_CCP_KEY		0x96		// Clear configuration protection key
-
-//***************************************************************************
-//* Programmer Commands
-//***************************************************************************
-#define LOAD			0x00		// Clear then load the page register
-#define PROG			0x48		// Program page with page register command
-#define ERS_G			0x72		// Erase global command 
-#define ERS_S			0x71		// Erase sector command
-#define ERS_P			0x70		// Erase page comand
-#define CONF			0x6C		// Access user config
-#define CRC_G			0x1A		// Global CRC
-#define CRC_S			0x19		// Sector CRC
-#define CRC_A			0x14		// CRC user config
-#define CCP				0x67		// Clear Configuration Protection
-
-//***************************************************************************
-//* ISP function codes
-//***************************************************************************
-#define PROGRAM			0			// program user code
-#define READ_VERSION	1			// read IAP/ISP version
-#define MISC_WRITE		2			// misc. write functions
-#define MISC_READ		3			// misc. read functions
-#define ERASE			4			// erase sector/page
-#define SECTOR_CRC		5			// read sector CRC
-#define GLOBAL_CRC		6			// read global CRC
-#define LOAD_BAUD		7			// not implemented
-#define CHIP_ERASE		9			// full chip erase 	`
-
-//***************************************************************************
-//* versions of ISP and ICP
-//***************************************************************************
-#define ISP_VERSION		0x06		// ICP version
-#define ICP_VERSION		0x06		// ICP version
-
-//***************************************************************************
-//* Functions
-//***************************************************************************
-void init(void);	              				// part initialization
-//***************************************************************************
-//* ICP Functions
-//***************************************************************************
-void enter_icp(void);
-void init_flash(void);
-void load_page(void);
-void program(void);
-void erase_global(void);
-void erase_sector(void);
-void erase_page(void);
-void crc_global(void);
-void crc_sector(void);
-void write_config(void);
-void read_config(void);
-void shift_out(char data_byte);
-char shift_in(void);
-//***************************************************************************
-//* ISP Functions
-//***************************************************************************
-void program_record(void);
-unsigned char echo();
-unsigned char get2();
-unsigned char ascii_to_hex(unsigned char ch);
-void print_hex_to_ascii(unsigned char ch);
-
-#define msec DelayMs
-
+//***************************************************************************
+//* 								progdef.h 
+//*	By : Bauke Siderius		
+//*	Discription : defenitions for programming commands for the LPC90x 
+//***************************************************************************
+
+//***************************************************************************
+//* Pin Definitions
+//***************************************************************************
+//#define ICP_PORT		GPIOA				// define GPIO port for ICP
+#define ICP_VCC			GPIO_Pin_2	// define VCC control pin
+#define ICP_RESET		GPIO_Pin_3	// define RESET control pin
+#define ICP_PCL			GPIO_Pin_4	// define PCL pin
+#define ICP_PDA			GPIO_Pin_5	// define PDA pin
+#define ICP_PDA_BIT		5			// bit number of PDA in the port
+#define ICP_PORT_OUT	R8_PA_OUT_0	// port byte holding PCL and PDA
+#define ICP_PORT_PIN	R8_PA_PIN_0	// input byte holding PDA
+#define ICP_PORT_DIR	R8_PA_DIR_0	// direction byte holding PDA
+#define ICP_DELAY()		for(delay = icp_half_period; delay; delay--) HAL_NOP()	// padding per PCL half period
+
+//***************************************************************************
+//* ICP transport, set ICP_SPI0 to 1 to run the bus from SPI0 on PA13-PA15
+//* (see icp_spi.h for the wiring) instead of bit-banging PA4/PA5
+//***************************************************************************
+#ifndef ICP_SPI0
+#define ICP_SPI0		0
+#endif
+
+//***************************************************************************
+//* ICP clock calibration, settings are delay loops per half period for the
+//* bit-bang transport and the SPI0_CLKCfg divider for SPI0, lower is faster.
+//* ICP_CLOCK_DEFAULT is used until calibrated and without calibration, the
+//* sweep starts from ICP_CLOCK_SLOW
+//***************************************************************************
+#ifndef ICP_CALIBRATE
+#define ICP_CALIBRATE	1			// calibrate the ICP clock at session start
+#endif
+#if ICP_SPI0
+#define ICP_CLOCK_DEFAULT 16		// SPI0 divider without calibration, 2MHz
+#define ICP_CLOCK_SLOW	32			// SPI0 divider the sweep starts from, 1MHz
+#define ICP_CLOCK_FAST	8			// fastest SPI0 divider, 4MHz keeps PCL half periods over 100ns
+#else
+#define ICP_CLOCK_DEFAULT 1			// delay loops without calibration, as the fixed padding was
+#define ICP_CLOCK_SLOW	32			// delay loops the sweep starts from
+#define ICP_CLOCK_FAST	0			// no padding at all
+#endif
+#define ICP_CLOCK_MARGIN 2			// steps slower than the fastest stable setting
+#define ICP_CLOCK_READS	16			// reads that must match at every step
+
+//***************************************************************************
+//* ICP transmit path for page bursts
+//***************************************************************************
+#if ICP_SPI0
+#define ICP_BURST_BEGIN()	icp_spi_burst_begin()
+#define ICP_BURST(b)		icp_spi_burst_byte(b)
+#define ICP_BURST_END()		icp_spi_burst_end()
+#else
+#define ICP_BURST_BEGIN()
+#define ICP_BURST(b)		shift_out(b)
+#define ICP_BURST_END()
+#endif
+
+//***************************************************************************
+//* ISP link, LOAD_BAUD switches the rate, the host must send the next
+//* record at the new rate within ISP_BAUD_TIMEOUT or the old one is restored
+//***************************************************************************
+#define ISP_BAUD_DEFAULT 19200		// baud rate after reset
+#define ISP_BAUD_ERROR	20			// largest rate error accepted, 0.1% units
+#define ISP_BAUD_TIMEOUT 2000		// msec to wait for a record at the new rate
+#ifndef ISP_AUTOBAUD
+#if HAL_HOST
+#define ISP_AUTOBAUD	0			// no capture timer on the host
+#else
+#define ISP_AUTOBAUD	1			// measure the rate from the ':' of a record
+#endif
+#endif
+#define ISP_AUTOBAUD_IDLE 20		// 100 msec ticks of silence before measuring again
+
+//***************************************************************************
+//* Target Flash geometry
+//***************************************************************************
+#define ICP_PAGE_SIZE	64			// bytes in the page register of the LPC9xx
+#define ICP_SECTOR_SIZE	1024		// bytes erased by ERS_S
+#define ICP_PAGES		(0x10000 / ICP_PAGE_SIZE)	// pages in the address space
+#define ICP_ERASED		0xFF		// value of an erased byte
+#define PAGE_IDLE_FLUSH	200			// 100us units of UART idle before a partial page is programmed
+
+//***************************************************************************
+//* Programmer Opcodes
+//***************************************************************************
+#define NOP				0x00		// No operation
+#define WR_FMADRL		0x08		// Write address low
+#define RD_FMADRL		0x09		// Read address low 
+#define WR_FMADRH		0x0A		// Write address high
+#define RD_FMADRH		0x0B		// Read address low
+#define WR_FMCON		0x0E		// Write a command to FMCON
+#define RD_FMCON		0x0F		// Read a command from FMCON
+#define WR_FMDATA_PG	0x14		// Write a command to FMDATA and inc addr
+#define RD_FMDATA_PG	0x15		// Read a coomand from FMDATA and inc addr
+#define WR_FMDATA		0x0C		// Write a data byte to FMDATA
+#define RD_FMDATA		0x0D		// Read a data byte from FMDATA
+#define WR_FMDATA_I		0x04		// Write a data byte to FMDATA and increment
+#define RD_FMDATA_I		0x05		// Read a data byte from FMDATA and increment
+#define CLR_CCP_KEY		0x96		// Clear configuration protection key
+
+//***************************************************************************
+//* Programmer Commands
+//***************************************************************************
+#define LOAD			0x00		// Clear then load the page register
+#define PROG			0x48		// Program page with page register command
+#define ERS_G			0x72		// Erase global command 
+#define ERS_S			0x71		// Erase sector command
+#define ERS_P			0x70		// Erase page comand
+#define CONF			0x6C		// Access user config
+#define CRC_G			0x1A		// Global CRC
+#define CRC_S			0x19		// Sector CRC
+#define CRC_A			0x14		// CRC user config
+#define CCP				0x67		// Clear Configuration Protection
+
+//***************************************************************************
+//* Flash command timing model, nominal duration in usec of each command.
+//* FMCON is first polled after this time and then every 1/ICP_POLL_DIVIDER
+//***************************************************************************
+#define ICP_TIME_PROG	2000		// program page register
+#define ICP_TIME_ERS_P	2000		// erase page
+#define ICP_TIME_ERS_S	2000		// erase sector
+#define ICP_TIME_ERS_G	2000		// erase global, after the dummy reads
+#define ICP_TIME_CRC_S	500			// sector CRC
+#define ICP_TIME_CRC_G	4000		// global CRC
+#define ICP_TIME_CONF	2000		// write config byte
+#define ICP_TIME_CCP	2000		// clear config protection
+#define ICP_POLL_DIVIDER 8			// polls per expected duration after the first
+#define ICP_POLL_MIN	20			// shortest poll interval in usec
+#define ICP_US(t)		((t) * (FREQ_SYS / 1000000))	// usec to TMR2 cycles
+
+//***************************************************************************
+//* ISP function codes
+//***************************************************************************
+#define PROGRAM			0			// program user code
+#define READ_VERSION	1			// read IAP/ISP version
+#define MISC_WRITE		2			// misc. write functions
+#define MISC_READ		3			// misc. read functions
+#define ERASE			4			// erase sector/page
+#define SECTOR_CRC		5			// read sector CRC
+#define GLOBAL_CRC		6			// read global CRC
+#define LOAD_BAUD		7			// switch the ISP baud rate
+#define CHIP_ERASE		9			// full chip erase 	`
+#define ICP_CLOCK		10			// read calibrated ICP clock setting
+#define COMPRESSED		11			// program RLE/LZ compressed data
+#define READ_FLASH		12			// read back a range of Flash
+#define READ_LINE		32			// data bytes per hex record of a read back
+#define BLANK_CHECK		13			// check a range of Flash for erased bytes
+
+//***************************************************************************
+//* MISC_WRITE/MISC_READ sub-functions in data_bytes[0] handled by the
+//* bridge itself, the LPC9xx config bytes are below 0x20
+//***************************************************************************
+#define MISC_ECHO		0x20		// write: data_bytes[1] 0 = no echo, 1 = echo
+#define MISC_BINARY		0x21		// write: data_bytes[1] 0 = hex records, 1 = binary frames
+#define MISC_WINDOW		0x22		// write: data_bytes[1] 0 = stop and wait, 1 = windowed
+#define MISC_ICP_STATS	0x20		// read: ICP counters, data_bytes[1] 1 = clear after
+#define MISC_LATENCY	0x21		// read: latency histograms, data_bytes[1] 1 = clear after, data_bytes[2] first one
+
+//***************************************************************************
+//* ISP record buffer
+//***************************************************************************
+#define HEX_BAD			0x10		// hex_values[] entry of a non hex character
+#define RECORD_SLOTS	2			// one being received, one for the target
+#define ACK_SLOTS		(ICP_PAGE_SIZE + 2)	// oks of the records in the page buffer and the two after
+#define ISP_RECORD_CHARS (1 + 2 * (5 + ICP_PAGE_SIZE) + 2)	// longest hex record with CR LF
+typedef struct
+{
+  unsigned char nbytes;						// number of data bytes
+  unsigned char address_high;				// high address
+  unsigned char address_low;				// low address
+  unsigned char record_type;				// record type
+  unsigned char sequence;					// sequence number for windowed replies
+  unsigned long received;					// time it was complete, for the latency histograms
+  unsigned char data[ICP_PAGE_SIZE];		// data buffer
+} isp_record;
+
+//***************************************************************************
+//* versions of ISP and ICP
+//***************************************************************************
+#define ISP_VERSION		0x06		// ICP version
+#define ICP_VERSION		0x06		// ICP version
+
+//***************************************************************************
+//* Functions
+//***************************************************************************
+void init(void);	              				// part initialization
+//***************************************************************************
+//* ICP Functions
+//***************************************************************************
+void enter_icp(void);
+void icp_sync(void);
+void icp_busy_start(unsigned long expected);
+void icp_set_clock(unsigned char setting);
+void icp_calibrate(void);
+unsigned char calibrate_read(unsigned char opcode);
+void init_flash(void);
+void load_page(void);
+void program(void);
+void program_page(unsigned char *page_data, unsigned char start, unsigned char end);
+void erase_global(void);
+void erase_sector(void);
+void erase_page(void);
+void crc_global(void);
+void crc_sector(void);
+void write_config(void);
+void read_config(void);
+void read_flash(void);
+void blank_check(void);
+void shift_out(char data_byte);
+char shift_in(void);
+//***************************************************************************
+//* ISP Functions
+//***************************************************************************
+void program_record(void);
+void load_baud(void);
+unsigned char receive_record(isp_record *record);
+void pipeline_service(void);
+void pipeline_queue(void);
+void pipeline_drain(void);
+void ack_queue(void);
+void dispatch_record(isp_record *record);
+void page_flush(void);
+void page_add(unsigned int address, unsigned char value);
+void erased_mark(unsigned int page, unsigned int count, unsigned char erased);
+unsigned char page_erased(unsigned int page);
+unsigned char echo();
+unsigned char record_waiting(void);
+unsigned char get2();
+
+#define msec HAL_DELAY_MS
+
@@ -0,0 +1,275 @@
+//***************************************************************************
+//* 								isp_binary.c
+//*	Discription : binary framed ISP protocol. A frame carries the same
+//*				fields as a hex record, but raw and with up to
+//*				BIN_FRAME_SIZE data bytes, so a program frame moves
+//*				about twice the data of hex over the same link.
+//*
+//*				Frames other than PROGRAM are copied into a record slot
+//*				and go through the record pipeline like hex records, the
+//*				reply formatter turns their replies into reply frames.
+//*				PROGRAM frames are cut into pieces for the page buffer.
+//*
+//***************************************************************************
+#include "hal.h"
+#include "progdef.h"
+#include "isp_uart.h"
+#include "isp_binary.h"
+#include "isp_unpack.h"
+#include "isp_latency.h"
+
+//***************************************************************************
+//* record state in main.c
+//***************************************************************************
+extern isp_record records[RECORD_SLOTS];
+extern unsigned char rx_slot;
+extern unsigned char record_pending;
+extern unsigned char ack_pending;
+extern unsigned char page_acks;
+extern unsigned char rx_sequence;
+extern unsigned char address_low;
+extern unsigned char address_high;
+extern unsigned char nbytes;
+extern unsigned char *data_bytes;
+
+//***************************************************************************
+//* frame buffers
+//***************************************************************************
+unsigned char isp_binary = 0;					// 1 when frames replace hex records
+unsigned char bin_frame[BIN_FRAME_SIZE];		// data of the received frame
+unsigned int bin_length;						// data bytes in bin_frame
+unsigned char bin_type;							// record type of the frame
+unsigned char bin_address_high;					// address of the frame
+unsigned char bin_address_low;
+unsigned char bin_sequence;						// sequence number of the frame
+unsigned long bin_received;						// time it was complete
+unsigned char bin_reply_data[BIN_FRAME_SIZE];	// data of the reply being put together
+unsigned int bin_reply_length = 0;				// data bytes in bin_reply_data
+const unsigned short bin_crc_nibbles[16] =		// CRC-16/CCITT, 4 bits at a time
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+//***************************************************************************
+//* bin_crc_update()
+//* Input(s) : crc, value.
+//* Returns : crc with value added.
+//* Description :
+//***************************************************************************
+unsigned short bin_crc_update(unsigned short crc, unsigned char value)
+{
+  crc = (crc << 4) ^ bin_crc_nibbles[(crc >> 12) ^ (value >> 4)];
+  crc = (crc << 4) ^ bin_crc_nibbles[(crc >> 12) ^ (value & 0x0F)];
+  return crc;
+}
+
+//***************************************************************************
+//* bin_get()
+//* Input(s) : value, where to put the byte.
+//* Returns : 0 when the host went quiet in the middle of a frame.
+//* Description : read the next byte of a frame
+//***************************************************************************
+static unsigned char bin_get(unsigned char *value)
+{
+  unsigned int wait;
+  for(wait = 0; !isp_uart_rx_count(); wait++)
+  {
+    if(wait == BIN_TIMEOUT)
+    {
+      return 0;
+    }
+    pipeline_service();
+    HAL_WAIT_US(10);
+  }
+  *value = isp_uart_getc();
+  return 1;
+}
+
+//***************************************************************************
+//* bin_receive_frame()
+//* Input(s) : none.
+//* Returns : 1 when a complete frame with a correct CRC was read.
+//* Description : bytes before the start of frame are skipped
+//***************************************************************************
+unsigned char bin_receive_frame(void)
+{
+  unsigned char header[5];
+  unsigned char value;
+  unsigned short crc;
+  unsigned int index;
+  unsigned long start;
+  do
+  {
+    while(!isp_uart_rx_count())					// wait for the host
+    {
+      pipeline_service();
+      HAL_IDLE();
+    }
+  } while(isp_uart_getc() != BIN_SOF);
+  start = LAT_NOW();
+  bin_sequence = rx_sequence++;					// numbered for window mode
+  crc = BIN_CRC_START;
+  for(index = 0; index < 5; index++)
+  {
+    if(!bin_get(&header[index])) return 0;
+    crc = bin_crc_update(crc, header[index]);
+  }
+  bin_length = header[0] | ((unsigned int)header[1] << 8);
+  bin_type = header[2];
+  bin_address_high = header[3];
+  bin_address_low = header[4];
+  if(bin_length > BIN_FRAME_SIZE)				// would overrun the frame buffer
+  {
+    return 0;
+  }
+  for(index = 0; index < bin_length; index++)
+  {
+    if(!bin_get(&bin_frame[index])) return 0;
+    crc = bin_crc_update(crc, bin_frame[index]);
+  }
+  if(!bin_get(&value) || (value != (unsigned char)(crc >> 8))) return 0;
+  if(!bin_get(&value) || (value != (unsigned char)crc)) return 0;
+  bin_received = LAT_RECEIVED(bin_type, start);
+  return 1;
+}
+
+//***************************************************************************
+//* bin_dispatch()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : carry out the received frame
+//***************************************************************************
+void bin_dispatch(void)
+{
+  unsigned int address;
+  unsigned int offset;
+  unsigned int index;
+  if(bin_type == PROGRAM)
+  {
+    while(record_pending || (ack_pending > page_acks))	// keep replies in frame order
+    {
+      pipeline_service();
+      HAL_IDLE();
+    }
+    LAT_RECORD_BEGIN(PROGRAM, bin_received);
+    address = ((unsigned int)bin_address_high << 8) | bin_address_low;
+    for(offset = 0; offset < bin_length; offset += nbytes)
+    {
+      nbytes = (bin_length - offset > ICP_PAGE_SIZE) ? ICP_PAGE_SIZE : (bin_length - offset);
+      address_high = (address + offset) >> 8;
+      address_low = (address + offset) & 0xFF;
+      data_bytes = &bin_frame[offset];
+      program_record();							// page buffer takes a copy
+    }
+    isp_reply_sequence = bin_sequence;
+    ack_queue();								// ok once the target is done
+    LAT_RECORD_END();
+    return;
+  }
+  if(bin_type == COMPRESSED)					// decoded straight from the frame
+  {
+    while(record_pending || (ack_pending > page_acks))
+    {
+      pipeline_service();
+      HAL_IDLE();
+    }
+    isp_reply_sequence = bin_sequence;
+    LAT_RECORD_BEGIN(COMPRESSED, bin_received);
+    if(unpack_record(((unsigned int)bin_address_high << 8) | bin_address_low, bin_frame, bin_length))
+    {
+      ack_queue();
+    }
+    else
+    {
+      pipeline_drain();						// oks of the page go first
+      isp_reply_sequence = bin_sequence;
+      isp_reply('R');
+    }
+    LAT_RECORD_END();
+    return;
+  }
+  if(bin_length > ICP_PAGE_SIZE)				// does not fit a record slot
+  {
+    pipeline_drain();
+    isp_reply_sequence = bin_sequence;
+    isp_reply('R');
+    return;
+  }
+  records[rx_slot].nbytes = bin_length;
+  records[rx_slot].address_high = bin_address_high;
+  records[rx_slot].address_low = bin_address_low;
+  records[rx_slot].record_type = bin_type;
+  records[rx_slot].sequence = bin_sequence;
+  records[rx_slot].received = bin_received;
+  for(index = 0; index < bin_length; index++)
+  {
+    records[rx_slot].data[index] = bin_frame[index];
+  }
+  pipeline_queue();
+}
+
+//***************************************************************************
+//* bin_service()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : read and carry out one frame, X for a damaged frame
+//***************************************************************************
+void bin_service(void)
+{
+  if(bin_receive_frame())
+  {
+    bin_dispatch();
+    return;
+  }
+  pipeline_drain();								// keep replies in frame order
+  isp_reply_sequence = bin_sequence;
+  isp_reply('X');
+}
+
+//***************************************************************************
+//* bin_reply_byte()
+//* Input(s) : value.
+//* Returns : none.
+//* Description : add a byte to the data of the reply frame
+//***************************************************************************
+void bin_reply_byte(unsigned char value)
+{
+  if(bin_reply_length < BIN_FRAME_SIZE)
+  {
+    bin_reply_data[bin_reply_length++] = value;
+  }
+}
+
+//***************************************************************************
+//* bin_reply()
+//* Input(s) : status, '.' ok, 'X' frame error, 'R' error.
+//* Returns : none.
+//* Description : queue the reply frame
+//***************************************************************************
+void bin_reply(unsigned char status)
+{
+  unsigned char header[4];
+  unsigned char trailer[2];
+  unsigned short crc;
+  unsigned int index;
+  header[0] = BIN_REPLY;
+  header[1] = status;
+  header[2] = bin_reply_length & 0xFF;
+  header[3] = bin_reply_length >> 8;
+  crc = BIN_CRC_START;
+  for(index = 1; index < 4; index++)
+  {
+    crc = bin_crc_update(crc, header[index]);
+  }
+  for(index = 0; index < bin_reply_length; index++)
+  {
+    crc = bin_crc_update(crc, bin_reply_data[index]);
+  }
+  trailer[0] = crc >> 8;
+  trailer[1] = crc & 0xFF;
+  isp_uart_write(header, 4);
+  isp_uart_write(bin_reply_data, bin_reply_length);
+  isp_uart_write(trailer, 2);
+  bin_reply_length = 0;
+}
@@ -0,0 +1,277 @@
+//***************************************************************************
+//* 								isp_latency.c
+//*	Discription : latency histograms on the SysTick time base. For every
+//*				record type the time to receive it, to carry it out, the
+//*				wait for an earlier flash command and the time until the
+//*				status of its reply is queued. For every ICP operation the
+//*				time up to its flash command and the flash command itself
+//*				until the background poll reads it done.
+//*
+//*				MISC_READ sub-function MISC_LATENCY sends the histograms
+//*				that have counts, from data_bytes[2] on. Each is a hex
+//*				record with the histogram number as the address and the
+//*				LAT_BUCKETS counts, 2 bytes MSB first, as the data. In
+//*				binary mode each is the histogram number followed by the
+//*				counts, as many as fit the reply frame; the host asks again
+//*				from the one after the last it got.
+//*
+//***************************************************************************
+#include "hal.h"
+#include "progdef.h"
+#include "isp_uart.h"
+#include "isp_binary.h"
+#include "isp_latency.h"
+
+//***************************************************************************
+//* histograms, counts stop at 0xFFFF
+//***************************************************************************
+unsigned short latency_hist[LAT_HISTS][LAT_BUCKETS];
+//***************************************************************************
+//* record and operation being timed
+//***************************************************************************
+unsigned char lat_type;							// record being carried out
+unsigned long lat_received;						// time it was received
+unsigned long lat_start;						// time it was started
+unsigned long lat_busy;							// usec it waited for the target
+unsigned char lat_in_record = 0;				// between begin and end
+unsigned char lat_reply_open = 0;				// status of its reply not sent yet
+unsigned char lat_op;							// ICP operation being timed
+unsigned long lat_op_start;						// time it started
+unsigned char lat_op_open = 0;					// flash command not started yet
+unsigned char lat_flash_op;						// operation of the running flash command
+unsigned long lat_flash_start;					// time it was started
+
+//***************************************************************************
+//* latency_add()
+//* Input(s) : hist, histogram number, usec.
+//* Returns : none.
+//* Description : count a time in its bucket
+//***************************************************************************
+void latency_add(unsigned char hist, unsigned long usec)
+{
+  unsigned char bucket = 0;
+  usec >>= LAT_UNIT_SHIFT;
+  while(usec && (bucket < LAT_BUCKETS - 1))		// bucket is the bit length
+  {
+    usec >>= 1;
+    bucket++;
+  }
+  if(latency_hist[hist][bucket] != 0xFFFF)
+  {
+    latency_hist[hist][bucket]++;
+  }
+}
+
+//***************************************************************************
+//* latency_received()
+//* Input(s) : type, record type, start, time of its first character.
+//* Returns : time the record was complete.
+//* Description :
+//***************************************************************************
+unsigned long latency_received(unsigned char type, unsigned long start)
+{
+  unsigned long now = HAL_TIME_US();
+  if(type < LAT_TYPES)
+  {
+    latency_add(LAT_RECORD(type, LAT_RECEIVE), now - start);
+  }
+  return now;
+}
+
+//***************************************************************************
+//* latency_record_begin()
+//* Input(s) : type, record type, received, time the record was complete.
+//* Returns : none.
+//* Description : a record is carried out from now on
+//***************************************************************************
+void latency_record_begin(unsigned char type, unsigned long received)
+{
+  lat_type = type;
+  lat_received = received;
+  lat_start = HAL_TIME_US();
+  lat_busy = 0;
+  lat_in_record = (type < LAT_TYPES);
+  lat_reply_open = lat_in_record;
+}
+
+//***************************************************************************
+//* latency_record_end()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : the record has been carried out, its flash command may
+//*				still be running
+//***************************************************************************
+void latency_record_end(void)
+{
+  latency_op_end();
+  if(lat_in_record)
+  {
+    latency_add(LAT_RECORD(lat_type, LAT_ICP), HAL_TIME_US() - lat_start - lat_busy);
+    latency_add(LAT_RECORD(lat_type, LAT_BUSY), lat_busy);
+    lat_in_record = 0;
+  }
+}
+
+//***************************************************************************
+//* latency_busy_wait()
+//* Input(s) : start, time the wait for the target began.
+//* Returns : none.
+//* Description : charge the wait to the record being carried out
+//***************************************************************************
+void latency_busy_wait(unsigned long start)
+{
+  if(lat_in_record)
+  {
+    lat_busy += HAL_TIME_US() - start;
+  }
+}
+
+//***************************************************************************
+//* latency_reply()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : the status of a reply is queued
+//***************************************************************************
+void latency_reply(void)
+{
+  if(lat_reply_open)
+  {
+    latency_add(LAT_RECORD(lat_type, LAT_REPLY), HAL_TIME_US() - lat_received);
+    lat_reply_open = 0;
+  }
+}
+
+//***************************************************************************
+//* latency_op_begin()
+//* Input(s) : op, ICP operation.
+//* Returns : none.
+//* Description :
+//***************************************************************************
+void latency_op_begin(unsigned char op)
+{
+  latency_op_end();
+  lat_op = op;
+  lat_op_start = HAL_TIME_US();
+  lat_op_open = 1;
+}
+
+//***************************************************************************
+//* latency_op_end()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : the operation is done with the bus
+//***************************************************************************
+void latency_op_end(void)
+{
+  if(lat_op_open)
+  {
+    latency_add(LAT_OP(lat_op, LAT_OP_ICP), HAL_TIME_US() - lat_op_start);
+    lat_op_open = 0;
+  }
+}
+
+//***************************************************************************
+//* latency_flash_start()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : the operation has started its flash command
+//***************************************************************************
+void latency_flash_start(void)
+{
+  latency_op_end();
+  lat_flash_op = lat_op;
+  lat_flash_start = HAL_TIME_US();
+}
+
+//***************************************************************************
+//* latency_flash_done()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : the background poll read FMCON done, from TMR2
+//***************************************************************************
+void latency_flash_done(void)
+{
+  latency_add(LAT_OP(lat_flash_op, LAT_OP_BUSY), HAL_TIME_US() - lat_flash_start);
+}
+
+//***************************************************************************
+//* latency_clear()
+//* Input(s) : none.
+//* Returns : none.
+//* Description :
+//***************************************************************************
+void latency_clear(void)
+{
+  unsigned char hist;
+  unsigned char bucket;
+  for(hist = 0; hist < LAT_HISTS; hist++)
+  {
+    for(bucket = 0; bucket < LAT_BUCKETS; bucket++)
+    {
+      latency_hist[hist][bucket] = 0;
+    }
+  }
+}
+
+//***************************************************************************
+//* latency_report()
+//* Input(s) : clear, 1 to clear once all were sent, first, histogram to
+//*			start from.
+//* Returns : none.
+//* Description : send the histograms that have counts and the ok message
+//***************************************************************************
+void latency_report(unsigned char clear, unsigned char first)
+{
+  unsigned char hist;
+  unsigned char bucket;
+  unsigned char used;
+  unsigned char sum;
+  unsigned int length = 0;
+  for(hist = first; hist < LAT_HISTS; hist++)
+  {
+    for(used = 0, bucket = 0; bucket < LAT_BUCKETS; bucket++)
+    {
+      used |= (latency_hist[hist][bucket] != 0);
+    }
+    if(!used)
+    {
+      continue;
+    }
+    if(isp_binary)
+    {
+      if(length + 1 + 2 * LAT_BUCKETS > BIN_FRAME_SIZE - 2)	// room for window mode
+      {
+        clear = 0;								// the host asks for the rest
+        break;
+      }
+      length += 1 + 2 * LAT_BUCKETS;
+      isp_reply_hex(hist);
+    }
+    else										// data record header
+    {
+      isp_reply_char(':');
+      isp_reply_hex(2 * LAT_BUCKETS);
+      isp_reply_hex(0x00);
+      isp_reply_hex(hist);
+      isp_reply_hex(0x00);
+    }
+    sum = 2 * LAT_BUCKETS + hist;
+    for(bucket = 0; bucket < LAT_BUCKETS; bucket++)
+    {
+      sum += (unsigned char)(latency_hist[hist][bucket] >> 8) + (unsigned char)latency_hist[hist][bucket];
+      isp_reply_hex(latency_hist[hist][bucket] >> 8);
+      isp_reply_hex(latency_hist[hist][bucket]);
+    }
+    if(!isp_binary)
+    {
+      isp_reply_hex(-sum);						// two's complement checksum
+      isp_reply_char('\r');
+      isp_reply_char('\n');
+    }
+  }
+  if(clear)
+  {
+    latency_clear();
+  }
+  isp_reply('.');								// send ok message
+}
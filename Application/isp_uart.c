@@ -0,0 +1,470 @@
+//***************************************************************************
+//* 								isp_uart.c
+//*	Discription : interrupt driven UART1 for the ISP link. The receive
+//*				interrupt empties the FIFO into a ring buffer as soon as
+//*				ISP_RX_TRIG bytes are waiting (or on the FIFO timeout), so
+//*				nothing is lost while the main loop is busy with the
+//*				target. Replies are queued in a second ring buffer and
+//*				fed to the FIFO from the THR empty interrupt. Replies
+//*				are put together in isp_reply_buffer and queued in one go,
+//*				or handed to the reply frame in binary mode.
+//*
+//*				With ISP_AUTOBAUD, TMR0 measures the widths between the
+//*				edges of RXD1. A ':' (0x3A) on the wire is low 2 bits
+//*				(start bit and bit 0), high 1, low 1, high 3 and low 2,
+//*				so when the last five widths have that shape their sum
+//*				is 9 bit times and UART1 is set to match. The garbled
+//*				characters received at the old rate are dropped and the
+//*				':' is put back in front of the rest of the record.
+//*
+//***************************************************************************
+#include "hal.h"
+#include "progdef.h"
+#include "isp_uart.h"
+#include "isp_binary.h"
+#include "isp_latency.h"
+
+#define ISP_RX_MASK		(ISP_RX_SIZE - 1)
+#define ISP_TX_MASK		(ISP_TX_SIZE - 1)
+
+//***************************************************************************
+//* ring buffers, the heads are written by the producer, the tails by the
+//* consumer only
+//***************************************************************************
+unsigned char isp_rx_buffer[ISP_RX_SIZE];		// received characters
+volatile unsigned int isp_rx_head = 0;			// next free entry, written by the ISR
+volatile unsigned int isp_rx_tail = 0;			// next character to read
+unsigned char isp_tx_buffer[ISP_TX_SIZE];		// characters to be sent
+volatile unsigned int isp_tx_head = 0;			// next free entry
+volatile unsigned int isp_tx_tail = 0;			// next character to send, written by the ISR
+volatile unsigned char isp_uart_status = 0;		// line errors seen, RB_LSR_ bits
+unsigned char isp_reply_buffer[ISP_REPLY_SIZE];	// reply being put together
+unsigned char isp_reply_length = 0;				// characters in isp_reply_buffer
+unsigned char isp_window = 0;					// replies carry sequence and credits
+unsigned char isp_reply_sequence = 0;			// sequence number of the record replied to
+const unsigned char isp_hex_digits[16] = "0123456789ABCDEF";
+#if ISP_AUTOBAUD
+//***************************************************************************
+//* autobaud state, TMR0 either captures edges or counts idle ticks
+//***************************************************************************
+volatile unsigned char isp_autobaud_armed = 0;	// TMR0 is capturing RXD1 edges
+volatile unsigned char isp_autobaud_found = 0;	// the rate was changed on a ':'
+volatile unsigned int isp_autobaud_head;		// receive head when the rate was changed
+unsigned long isp_edge_widths[5];				// last widths between RXD1 edges
+unsigned char isp_edge_count = 0;				// valid entries in isp_edge_widths
+unsigned int isp_idle_head;						// receive head at the last idle tick
+unsigned char isp_idle_ticks = 0;				// idle ticks without a character
+const unsigned char isp_colon_bits[5] = {2, 1, 1, 3, 2};	// bit times between the edges of ':'
+#endif
+
+//***************************************************************************
+//* isp_uart_init()
+//* Input(s) : baudrate.
+//* Returns : none.
+//* Description : set up UART1 with receive and line status interrupts
+//***************************************************************************
+void isp_uart_init(unsigned long baudrate)
+{
+  isp_rx_head = isp_rx_tail = 0;
+  isp_tx_head = isp_tx_tail = 0;
+  hal_uart_init(baudrate);
+#if ISP_AUTOBAUD
+  isp_autobaud_init();
+#endif
+}
+
+#if ISP_AUTOBAUD
+//***************************************************************************
+//* isp_autobaud_take()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : after a rate change drop what came in at the old rate and
+//*				put the measured ':' back, only the tail is touched here
+//***************************************************************************
+static void isp_autobaud_take(void)
+{
+  if(isp_autobaud_found)
+  {
+    isp_autobaud_found = 0;
+    isp_rx_tail = (isp_autobaud_head - 1) & ISP_RX_MASK;
+    isp_rx_buffer[isp_rx_tail] = ':';
+  }
+}
+#else
+#define isp_autobaud_take()
+#endif
+
+//***************************************************************************
+//* isp_uart_rx_count()
+//* Input(s) : none.
+//* Returns : number of received characters waiting in the buffer.
+//* Description :
+//***************************************************************************
+unsigned int isp_uart_rx_count(void)
+{
+  isp_autobaud_take();
+  return (isp_rx_head - isp_rx_tail) & ISP_RX_MASK;
+}
+
+//***************************************************************************
+//* isp_uart_getc()
+//* Input(s) : none.
+//* Returns : next received character.
+//* Description : waits until a character is available
+//***************************************************************************
+unsigned char isp_uart_getc(void)
+{
+  unsigned char ch;
+  while(!isp_uart_rx_count())					// wait for the receive interrupt
+  {
+    HAL_IDLE();
+  }
+  ch = isp_rx_buffer[isp_rx_tail];
+  isp_rx_tail = (isp_rx_tail + 1) & ISP_RX_MASK;
+  return ch;
+}
+
+//***************************************************************************
+//* isp_uart_peek()
+//* Input(s) : none.
+//* Returns : next received character, it is left in the buffer.
+//* Description : waits until a character is available
+//***************************************************************************
+unsigned char isp_uart_peek(void)
+{
+  while(!isp_uart_rx_count())					// wait for the receive interrupt
+  {
+    HAL_IDLE();
+  }
+  return isp_rx_buffer[isp_rx_tail];
+}
+
+//***************************************************************************
+//* isp_uart_rx_flush()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : throw away everything received so far
+//***************************************************************************
+void isp_uart_rx_flush(void)
+{
+  isp_rx_tail = isp_rx_head;
+}
+
+//***************************************************************************
+//* isp_tx_fill()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : move queued characters into the transmit FIFO, the THR
+//*				empty interrupt is only left on while characters are queued
+//***************************************************************************
+static void isp_tx_fill(void)
+{
+  while((isp_tx_tail != isp_tx_head) && (HAL_UART_TX_LEVEL() < UART_FIFO_SIZE))
+  {
+    HAL_UART_TX_BYTE(isp_tx_buffer[isp_tx_tail]);
+    isp_tx_tail = (isp_tx_tail + 1) & ISP_TX_MASK;
+  }
+  if(isp_tx_tail == isp_tx_head)
+    HAL_UART_TX_IRQ_OFF();
+  else
+    HAL_UART_TX_IRQ_ON();
+}
+
+//***************************************************************************
+//* isp_tx_start()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : feed the FIFO from outside the ISR
+//***************************************************************************
+static void isp_tx_start(void)
+{
+  HAL_UART_IRQ_DISABLE();						// the ISR also feeds the FIFO
+  isp_tx_fill();
+  HAL_UART_IRQ_ENABLE();
+}
+
+//***************************************************************************
+//* isp_uart_putc()
+//* Input(s) : ch.
+//* Returns : none.
+//* Description : queue a character, waits while the buffer is full
+//***************************************************************************
+void isp_uart_putc(unsigned char ch)
+{
+  isp_uart_write(&ch, 1);
+}
+
+//***************************************************************************
+//* isp_uart_write()
+//* Input(s) : buffer, length.
+//* Returns : none.
+//* Description : queue a block of characters, the FIFO is only started
+//*				once for the whole block unless the buffer fills up
+//***************************************************************************
+void isp_uart_write(const unsigned char *buffer, unsigned int length)
+{
+  unsigned int next;
+  while(length--)
+  {
+    next = (isp_tx_head + 1) & ISP_TX_MASK;
+    if(next == isp_tx_tail)
+    {
+      isp_tx_start();
+      while(next == isp_tx_tail)				// wait for the THR empty interrupt
+      {
+        HAL_IDLE();
+      }
+    }
+    isp_tx_buffer[isp_tx_head] = *buffer++;
+    isp_tx_head = next;
+  }
+  isp_tx_start();
+}
+
+//***************************************************************************
+//* isp_reply_char()
+//* Input(s) : ch.
+//* Returns : none.
+//* Description : add a character to the reply
+//***************************************************************************
+void isp_reply_char(unsigned char ch)
+{
+  if(isp_reply_length == ISP_REPLY_SIZE)		// long reply, pass on what we have
+  {
+    isp_uart_write(isp_reply_buffer, isp_reply_length);
+    isp_reply_length = 0;
+  }
+  isp_reply_buffer[isp_reply_length++] = ch;
+}
+
+//***************************************************************************
+//* isp_reply_hex()
+//* Input(s) : value.
+//* Returns : none.
+//* Description : add a byte as two hex digits to the reply
+//***************************************************************************
+void isp_reply_hex(unsigned char value)
+{
+  if(isp_binary)								// raw byte in a reply frame
+  {
+    bin_reply_byte(value);
+    return;
+  }
+  isp_reply_char(isp_hex_digits[value >> 4]);
+  isp_reply_char(isp_hex_digits[value & 0x0F]);
+}
+
+//***************************************************************************
+//* isp_reply()
+//* Input(s) : status, '.' ok, 'X' checksum error, 'R' error.
+//* Returns : none.
+//* Description : end the reply with the status line and queue it. In
+//*				window mode the sequence number and the credits follow the
+//*				status, in binary mode they end the reply data
+//***************************************************************************
+void isp_reply(unsigned char status)
+{
+  LAT_REPLY_SENT();
+  if(isp_binary)
+  {
+    if(isp_window)
+    {
+      bin_reply_byte(isp_reply_sequence);
+      bin_reply_byte(isp_window_credits());
+    }
+    bin_reply(status);
+    return;
+  }
+  isp_reply_char(status);
+  if(isp_window)
+  {
+    isp_reply_hex(isp_reply_sequence);
+    isp_reply_hex(isp_window_credits());
+  }
+  isp_reply_char('\r');
+  isp_reply_char('\n');
+  isp_uart_write(isp_reply_buffer, isp_reply_length);
+  isp_reply_length = 0;
+}
+
+//***************************************************************************
+//* isp_uart_tx_idle()
+//* Input(s) : none.
+//* Returns : 1 when every queued character has left the shift register.
+//* Description :
+//***************************************************************************
+unsigned char isp_uart_tx_idle(void)
+{
+  return (isp_tx_tail == isp_tx_head) && HAL_UART_TX_EMPTY();
+}
+
+//***************************************************************************
+//* isp_window_credits()
+//* Input(s) : none.
+//* Returns : number of longest records that fit the free receive buffer.
+//* Description : the host keeps no more records unanswered than this
+//***************************************************************************
+unsigned char isp_window_credits(void)
+{
+  unsigned int credits;
+  credits = (ISP_RX_SIZE - 1 - isp_uart_rx_count()) / (isp_binary ? (BIN_FRAME_SIZE + 8) : ISP_RECORD_CHARS);
+  return (credits > 255) ? 255 : credits;
+}
+
+//***************************************************************************
+//* UART1_IRQHandler()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : fill the receive buffer, feed the transmit FIFO
+//***************************************************************************
+void UART1_IRQHandler(void)
+{
+  unsigned int next;
+  unsigned char ch;
+  switch(HAL_UART_FLAG())
+  {
+    case UART_II_LINE_STAT:
+      ch = HAL_UART_LINE();
+      isp_uart_status |= ch & (RB_LSR_OVER_ERR | RB_LSR_PAR_ERR | RB_LSR_FRAME_ERR | RB_LSR_BREAK_ERR);
+#if ISP_AUTOBAUD
+      if((ch & RB_LSR_FRAME_ERR) && !isp_autobaud_armed)
+        isp_autobaud_arm();						// host may be at another rate
+#endif
+      break;
+    case UART_II_RECV_RDY:
+    case UART_II_RECV_TOUT:
+      while(HAL_UART_RX_LEVEL())
+      {
+        ch = HAL_UART_RX_BYTE();
+        next = (isp_rx_head + 1) & ISP_RX_MASK;
+        if(next == isp_rx_tail)					// buffer full, drop the character
+          isp_uart_status |= RB_LSR_OVER_ERR;
+        else
+        {
+          isp_rx_buffer[isp_rx_head] = ch;
+          isp_rx_head = next;
+        }
+      }
+      break;
+    case UART_II_THR_EMPTY:
+      isp_tx_fill();
+      break;
+  }
+}
+
+#if ISP_AUTOBAUD
+//***************************************************************************
+//* isp_autobaud_init()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : route CAP0 to PB19 and measure the first ':'
+//***************************************************************************
+void isp_autobaud_init(void)
+{
+  GPIOB_ModeCfg(ISP_CAP_PIN, GPIO_ModeIN_PU);
+  GPIOPinRemap(ENABLE, RB_PIN_TMR0);
+  TMR0_ClearITFlag(TMR0_3_IT_CYC_END | TMR0_3_IT_DATA_ACT);
+  TMR0_ITCfg(ENABLE, TMR0_3_IT_CYC_END | TMR0_3_IT_DATA_ACT);
+  NVIC_SetPriority(TMR0_IRQn, HAL_PRIO_UART);
+  NVIC_EnableIRQ(TMR0_IRQn);
+  isp_autobaud_arm();
+}
+
+//***************************************************************************
+//* isp_autobaud_arm()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : capture the widths between RXD1 edges until a ':' is seen
+//***************************************************************************
+void isp_autobaud_arm(void)
+{
+  isp_edge_count = 0;
+  isp_autobaud_armed = 1;
+  TMR0_CAPTimeoutCfg(ISP_CAP_TIMEOUT);
+  TMR0_CapInit(Edge_To_Edge);
+}
+
+//***************************************************************************
+//* isp_autobaud_idle()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : stop capturing, count idle ticks instead
+//***************************************************************************
+static void isp_autobaud_idle(void)
+{
+  isp_autobaud_armed = 0;
+  isp_idle_head = isp_rx_head;
+  isp_idle_ticks = 0;
+  TMR0_TimerInit(ISP_AUTOBAUD_TICK);
+}
+
+//***************************************************************************
+//* isp_edge_width()
+//* Input(s) : width, Fsys cycles between two RXD1 edges.
+//* Returns : none.
+//* Description : check the last five widths against the shape of a ':'
+//***************************************************************************
+static void isp_edge_width(unsigned long width)
+{
+  unsigned char index;
+  unsigned long sum;
+  unsigned long divisor;
+  long error;
+  sum = 0;
+  for(index = 0; index < 4; index++)
+  {
+    isp_edge_widths[index] = isp_edge_widths[index + 1];
+    sum += isp_edge_widths[index];
+  }
+  isp_edge_widths[4] = width;
+  sum += width;
+  if(isp_edge_count < 5)
+  {
+    if(++isp_edge_count < 5) return;
+  }
+  for(index = 0; index < 5; index++)			// every width within 1/4 bit
+  {
+    error = (long)(9 * isp_edge_widths[index]) - (long)(isp_colon_bits[index] * sum);
+    if((error > (long)(sum / 4)) || (error < -(long)(sum / 4))) return;
+  }
+  divisor = (sum + 36) / 72;					// Fsys / 8 / baud, sum is 9 bit times
+  if((divisor == 0) || (divisor > 0xFFFF)) return;
+  error = (long)divisor - (long)HAL_UART_DIVISOR;
+  if((error * 50 > (long)divisor) || (error * 50 < -(long)divisor))	// more than 2% off
+  {
+    HAL_UART_DIVISOR = (unsigned short)divisor;
+    UART1_CLR_RXFIFO();
+    isp_autobaud_head = isp_rx_head;
+    isp_autobaud_found = 1;
+  }
+  isp_autobaud_idle();
+}
+
+//***************************************************************************
+//* TMR0_IRQHandler()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : take captured widths, or count idle ticks and measure
+//*				again when the host has been quiet for ISP_AUTOBAUD_IDLE
+//***************************************************************************
+void TMR0_IRQHandler(void)
+{
+  TMR0_ClearITFlag(TMR0_3_IT_CYC_END | TMR0_3_IT_DATA_ACT);
+  if(isp_autobaud_armed)
+  {
+    while(isp_autobaud_armed && TMR0_CAPDataCounter())
+    {
+      isp_edge_width(TMR0_CAPGetData() & ISP_CAP_MASK);
+    }
+  }
+  else if(isp_rx_head != isp_idle_head)
+  {
+    isp_idle_head = isp_rx_head;
+    isp_idle_ticks = 0;
+  }
+  else if(++isp_idle_ticks >= ISP_AUTOBAUD_IDLE)
+  {
+    isp_autobaud_arm();
+  }
+}
+#endif
@@ -0,0 +1,136 @@
+//***************************************************************************
+//* 								isp_unpack.c
+//*	Discription : decoder for COMPRESSED records. The output goes byte by
+//*				byte into the page buffer through page_add(), so only the
+//*				last UNPACK_WINDOW output bytes are kept for copies. The
+//*				window carries over to the next COMPRESSED record when it
+//*				continues at the address where this one stopped, a token
+//*				never spans two records. The stream is checked before
+//*				anything is output, a broken record leaves the page buffer
+//*				and the window as they were.
+//*
+//***************************************************************************
+#include "hal.h"
+#include "progdef.h"
+#include "isp_unpack.h"
+
+//***************************************************************************
+//* decoder state
+//***************************************************************************
+unsigned char unpack_history[UNPACK_WINDOW];	// last output bytes
+unsigned char unpack_position = 0;				// next entry in unpack_history, wraps
+unsigned int unpack_filled = 0;					// valid entries in unpack_history
+unsigned int unpack_next = 0;					// address after the last output byte
+
+//***************************************************************************
+//* unpack_output()
+//* Input(s) : value.
+//* Returns : none.
+//* Description : program one output byte and keep it for copies
+//***************************************************************************
+static void unpack_output(unsigned char value)
+{
+  page_add(unpack_next, value);
+  unpack_next = (unpack_next + 1) & 0xFFFF;		// wraps like the target
+  unpack_history[unpack_position++] = value;
+  if(unpack_filled < UNPACK_WINDOW)
+  {
+    unpack_filled++;
+  }
+}
+
+//***************************************************************************
+//* unpack_check()
+//* Input(s) : data, length of data, filled, valid window entries at the
+//*			start of the record.
+//* Returns : 0 when the stream is broken, 1 otherwise.
+//* Description : walk the tokens without output, every operand must be in
+//*				the record and every copy inside the window
+//***************************************************************************
+static unsigned char unpack_check(unsigned char *data, unsigned int length, unsigned int filled)
+{
+  unsigned int index;
+  unsigned char token;
+  unsigned char count;
+  index = 0;
+  while(index < length)
+  {
+    token = data[index++];
+    if(token < UNPACK_RUN)						// literal bytes
+    {
+      count = (token & 0x7F) + 1;
+      if(length - index < count) return 0;
+      index += count;
+    }
+    else										// run or copy, one operand
+    {
+      if(index == length) return 0;
+      count = (token & 0x3F) + UNPACK_MIN;
+      if((token >= UNPACK_COPY) && (data[index] >= filled)) return 0;	// distance is data + 1
+      index++;
+    }
+    filled += count;
+    if(filled > UNPACK_WINDOW)
+    {
+      filled = UNPACK_WINDOW;
+    }
+  }
+  return 1;
+}
+
+//***************************************************************************
+//* unpack_record()
+//* Input(s) : address of the first output byte, data, length of data.
+//* Returns : 0 when the stream is broken, 1 otherwise.
+//* Description : decode one compressed record into the page buffer, a
+//*				broken one is refused before any output
+//***************************************************************************
+unsigned char unpack_record(unsigned int address, unsigned char *data, unsigned int length)
+{
+  unsigned int index;
+  unsigned char token;
+  unsigned char count;
+  unsigned char value;
+  unsigned int distance;
+  if(!unpack_check(data, length, (address == unpack_next) ? unpack_filled : 0))
+  {
+    return 0;
+  }
+  if(address != unpack_next)					// not a continuation, no history
+  {
+    unpack_filled = 0;
+    unpack_next = address;
+  }
+  index = 0;
+  while(index < length)
+  {
+    token = data[index++];
+    if(token < UNPACK_RUN)						// literal bytes
+    {
+      count = (token & 0x7F) + 1;
+      while(count--)
+      {
+        unpack_output(data[index++]);
+      }
+    }
+    else if(token < UNPACK_COPY)				// run of one value
+    {
+      count = (token & 0x3F) + UNPACK_MIN;
+      value = data[index++];
+      while(count--)
+      {
+        unpack_output(value);
+      }
+    }
+    else										// copy from the window
+    {
+      count = (token & 0x3F) + UNPACK_MIN;
+      distance = data[index++] + 1;
+      while(count--)								// may overlap its own output
+      {
+        unpack_output(unpack_history[(unsigned char)(unpack_position - distance)]);
+      }
+    }
+  }
+  return 1;
+}
@@ -1,585 +1,1390 @@
-//***************************************************************************
-//* 								ISP_to_ICP_bridge.c 
-//*	By : Bauke Siderius		
-//*	Discription : ISP/ICP gateway code for LPC900 programmer using MCB900 
-//*
-//***************************************************************************
-//* Versions
-//***************************************************************************
-//*
-//* v1.6	October 2005
-//*			Fixed the program command, a load command has to be given before
-//*	  		putting Data in FM_DATA
-//*
-//* v1.5	September 2005
-//*			Added support for the Clear Configuration Protection	
-//*
-//* v1.4 	December 2004
-//*			Erase sector and erase page fix.
-//*
-//* v1.3	March 2004
-//*			Increased data buffer size to 64 to support LPC92x in FlashMagic.	
-//*
-//* v1.2	August 2003
-//*			Added a delay before entering ICP.	
-//*
-//* v1.1 	August 2003
-//*			Put ports in input only when not in use.
-//*			Fixed CRC read out.
-//*
-//* v1.0 	May 2003
-//* 		Initial version.
-//*
-//***************************************************************************
-#include "CH57x_common.h"
-#include "progdef.h"
-#include <stdio.h>
-
-//***************************************************************************
-//* variables used for passing parameters
-//***************************************************************************
-unsigned char reg7;
-//***************************************************************************
-//* buffers for read record
-//***************************************************************************
-unsigned char address_low = 0;					// low address
-unsigned char address_high = 0;					// high address
-unsigned char checksum = 0;						// checksum
-unsigned char nbytes = 0;						// number of data bytes
-unsigned char record_type = 0;					// record type
-unsigned char data_bytes[64];				// data buffer
-unsigned char program_byte;						// byte to be programmed
-
-//***************************************************************************
-//* init()
-//* Input(s) : none.
-//* Returns : none.
-//* Description : initialization of P89LPC932
-//***************************************************************************
-void init(void)
-{
-	/* GPIO for ICP */
-	GPIOA_ResetBits(ICP_VCC);
-	GPIOA_ModeCfg(ICP_VCC, GPIO_ModeOut_PP_20mA);
-	GPIOA_ModeCfg(ICP_RESET | ICP_PCL | ICP_PDA, GPIO_ModeOut_PP_5mA);
-
-	/* GPIO for UART */
-  GPIOA_SetBits(GPIO_Pin_9);
-  GPIOA_ModeCfg(GPIO_Pin_8, GPIO_ModeIN_PU);
-	GPIOA_ModeCfg(GPIO_Pin_9, GPIO_ModeOut_PP_5mA);
-
-	/* ISP UART */
-  UART1_DefInit();
-	UART1_BaudRateCfg(19200);
-}
-
-//***************************************************************************
-//* main()
-//* Input(s) : none.
-//* Returns : none.
-//* Description : main loop
-//***************************************************************************
-int main(void)
-{
-	unsigned char index;
-  init();
-  msec(500);									// delay 500 msec to sabalize before entering ICP mode
-  enter_icp();									// go into ICP mode
-  while(1)										// HexFile Loader
-  {		
-    checksum = 0;								// clear checksum before loading file
-    while(echo() != ':');						// record starts with a ':'	
-    nbytes = get2();							// get number of bytes in record
-    address_high = get2();						// get MSB of load address
-    address_low = get2();						// get LSB of load address
-    record_type = get2();						// get record type
-    for(index=0; index < nbytes; index++)		// read record data to buffer
-    {
-      data_bytes[index] = get2();				// put databytes in an array
-    }
-    reg7 = checksum;							// put calculated checksum in reg7
-    if (reg7 != get2())							// read and check checksum on record
-    {
-      printf("X\r\n");							// print error message					
-      continue;									// restart HexLoader
-    }
-    switch(record_type)							// switch on record type
-    {
-      case PROGRAM:								// program record type
-      {
-        program_record();						//
-        printf(".\r\n");							// send ok message
-	      break;
-	    }
-	    case READ_VERSION:						// read version record type
-	    {
-	      print_hex_to_ascii(ISP_VERSION);		// send ISP version
-	      print_hex_to_ascii(ICP_VERSION);		// send ICP version
-        printf(".\r\n");							// send ok message     
-	      break;
-	    }
-	    case MISC_WRITE:							// misc write record type
-	    { 
-        write_config();							// write config byte
-        printf(".\r\n");							// send ok message
-	      break;
-	    }
-	    case MISC_READ:							// misc read record type
-	    {
-        read_config();							// read config byte
-	    	print_hex_to_ascii(data_bytes[0]);		// send config byte in ascii
-        printf(".\r\n");							// send ok message
-	      break;
-	    }
-	    case ERASE:								// erase record type
-	    {
-        if(data_bytes[0] == 0)					// check if dbytes[0] indicates page erase
-        {
-	        erase_page();							// try erase a page and get status
-          printf(".\r\n");						// send ok message
-		    }  
-		    else if(data_bytes[0] == 1)				// check if dbytes[0] indicates sector erase
-		    {
-  		    erase_sector();						// try erase a sector and get status
-          printf(".\r\n");						// send ok message
-		    }
-		    else
-        {
-          printf("R\r\n");						// send error message
-        }
-	      break;
-	    }
-      case SECTOR_CRC:							// sector CRC record type
-      {
-        crc_sector();							// try sector CRC and get status
-        print_hex_to_ascii(data_bytes[3]);		// send first CRC in ascii
-        print_hex_to_ascii(data_bytes[2]);		// send second CRC in ascii
-        print_hex_to_ascii(data_bytes[1]);		// send third CRC in ascii
-        print_hex_to_ascii(data_bytes[0]);		// send fourth CRC in ascii
-        printf(".\r\n");							// send ok message
-        break;
-      }
-      case GLOBAL_CRC:
-      {  	
-        crc_global();
-        print_hex_to_ascii(data_bytes[3]);		// send first CRC in ascii
-        print_hex_to_ascii(data_bytes[2]);		// send second CRC in ascii
-        print_hex_to_ascii(data_bytes[1]);		// send third CRC in ascii
-        print_hex_to_ascii(data_bytes[0]);		// send fourth CRC in ascii
-        printf(".\r\n");							// send ok message
-        break;
-	    }
-      case CHIP_ERASE:							// chip erase record type	
-      {
-        erase_global();							// try erase global and get status
-        printf(".\r\n");							// send ok message
-	      break;
-	    }
-      default:									// incorrect record type	
-      {
-        printf("R\r\n");							// send error message
-        break;
-      }	  
-	  }
-  }	
-}
-
-//***************************************************************************
-//* enter_icp()
-//* Input(s) : none.
-//* Returns : none.
-//* Description : function to pulse reset to enter ICP mode
-//***************************************************************************
-void enter_icp(void)
-{	
-  char pulses = 0;
-
-	/* Power off target */
-	GPIOA_ResetBits(ICP_VCC | ICP_RESET);
-	msec(10);
-	/* Power on target with reset held low */
-	GPIOA_SetBits(ICP_VCC);
-	msec(5);
-  for(pulses = 0; pulses < 7; pulses++)			// pulse reset 7 times
-  {
-    GPIOA_SetBits(ICP_RESET);
-    DelayUs(30);			// wait about 15 usec
-		GPIOA_ResetBits(ICP_RESET);
-    DelayUs(30);			// wait about 15 usec
-  }
-  GPIOA_SetBits(ICP_RESET);									// hold reset high
-}
-
-//***************************************************************************
-//* shift_out()
-//* Input(s) : data_byte.
-//* Returns : none.
-//* Description : function to shift out data to the part being programmed
-//***************************************************************************
-void shift_out(char data_byte)
-{
-  char shift_bit;	
-  char temp_byte = 0;
-	GPIOA_ModeCfg(ICP_PDA, GPIO_ModeOut_PP_5mA);
-  temp_byte = data_byte;						// put databyte in a temp byte
-  for(shift_bit = 0; shift_bit < 8; shift_bit++)// shift out 8 bits
-  {
-    GPIOA_ResetBits(ICP_PCL);									// hold clock line low
-    if(temp_byte & 0x01)						// check if LSB is set
-    {
-      GPIOA_SetBits(ICP_PDA);									// set data-line high
-    }
-    else
-    {
-      GPIOA_ResetBits(ICP_PDA);									// set data-line low
-    }
-	temp_byte = (data_byte >>= 1); 				// shift databyte right one, put in temp
-	GPIOA_SetBits(ICP_PCL);									// clock  databit
-  }
-  GPIOA_SetBits(ICP_PDA);										// set dataline high after transfer
-  GPIOA_SetBits(ICP_PCL);										// hold dataline high after transfer
-}	
-
-//***************************************************************************
-//* shift_in()
-//* Input(s) : none.
-//* Returns : Data shifted back from part that is being programmed.
-//* Description : function read data from the part being programmed
-//***************************************************************************
-char shift_in(void)
-{
-  char data_byte = 0;
-  char shift_bit = 0;
-  GPIOA_ResetBits(ICP_PCL);
-  GPIOA_ModeCfg(ICP_PDA, GPIO_ModeIN_Floating);
-  for(shift_bit = 0; shift_bit < 8; shift_bit++)// shift in 8 bits
-  {
-		GPIOA_SetBits(ICP_PCL);									// clock out databit
-	if(GPIOA_ReadPortPin(ICP_PDA))										// check if PDA is set	
-	{
-	  data_byte |= 0x80;						// set bit
-    }
-    else
-	{
-  	  data_byte &= ~0x80;						// or clear bit
-    }
-    if(shift_bit < 7)							// don't shift last bit MSB
-    {	
- 	  data_byte >>= 1;
-    }
-	GPIOA_ResetBits(ICP_PCL);									// hold clock line low
-  }
-  GPIOA_ResetBits(ICP_PCL);										// set clockline low after transfer
-  GPIOA_SetBits(ICP_PDA);										// hold dataline high
-	GPIOA_ModeCfg(ICP_PDA, GPIO_ModeOut_PP_5mA);
-  return data_byte;								// return clocked in bit
-}
-
-//***************************************************************************
-//* program()
-//* Input(s) : none.
-//* Returns : none.
-//* Description : funtion to program the page register into Flash
-//***************************************************************************
-void program(void)
-{
-  unsigned char read_data = 0;
-  shift_out(WR_FMADRL);							// write address low command page aligned
-  shift_out(address_low);						// write address from the isp command
-  shift_out(WR_FMADRH);							// write address high command
-  shift_out(address_high);						// write address from the isp command
-  shift_out(WR_FMCON);							// write to FMCON
-  shift_out(LOAD);								// load commmand 
-  shift_out(WR_FMDATA);							// write to FMDATA
-  shift_out(program_byte);						// load databyte
-  shift_out(WR_FMCON);							// write to FMCON
-  shift_out(PROG);								// program commmand
-  do
-  {
-    shift_out(RD_FMCON);						// read FMCON command
-	read_data = shift_in();						// shift in data from FMCON
-  }
-  while(read_data & 0x80);						// check for done status MSB
-}
-
-//***************************************************************************
-//* erase_global()
-//* Input(s) : none.
-//* Returns : none.
-//* Description : function to erase all Flash and config
-//***************************************************************************
-void erase_global(void)
-{
-  unsigned char read_data = 0;
-  char index, dummy;
-  shift_out(WR_FMCON);							// write FMCON command
-  shift_out(ERS_G);								// write erase global command
-//***************************************************************************
-//* This code must be added due to a bug in erase global
-//* otherwise it will stay busy forever
-//***************************************************************************
-  for(index = 0; index < 50; index++)			// read for about 5ms
-  {
-    shift_out(RD_FMDATA_I);						// read data increment address
-    dummy = shift_in();							// do dummy reads
-  } 
-//***************************************************************************
-//* End added code for erase global bug
-//***************************************************************************
-  do										
-  {
-    shift_out(RD_FMCON);						// read FMCON command
-	read_data = shift_in();						// shift in data from FMCON
-  }
-  while(read_data & 0x80);						// check for done status MSB 
-}
-
-//***************************************************************************
-//* erase_sector()
-//* Input(s) : none.
-//* Returns : none.
-//* Description : function to erase a sector in Flash
-//***************************************************************************
-void erase_sector(void)
-{
-  unsigned char read_data = 0;
-  shift_out(WR_FMADRH);							// write address high command
-  shift_out(data_bytes[1]);						// write address stripped from the isp command
-  shift_out(WR_FMCON);							// write to FMCON
-  shift_out(ERS_S);								// write erase sector command
-  do
-  {
-    shift_out(RD_FMCON);						// read FMCON command
-	read_data = shift_in();						// shift in data from FMCON
-  }
-  while(read_data & 0x80);						// check for done status MSB   
-}
-
-//***************************************************************************
-//* erase_page()
-//* Input(s) : none.
-//* Returns : none.
-//* Description : function to erase a page in Flash
-//***************************************************************************
-void erase_page(void)
-{
-  unsigned char read_data = 0;					// declare local read_data variable
-  shift_out(WR_FMADRL);							// write address low command
-  shift_out(data_bytes[2]);						// write address stripped from the isp command
-  shift_out(WR_FMADRH);							// write address high command
-  shift_out(data_bytes[1]);						// write address stripped form the isp command
-  shift_out(WR_FMCON);							// write to FMCON
-  shift_out(ERS_P);								// write erase page command
-  do											// loop till status is done
-  {
-    shift_out(RD_FMCON);						// read FMCON command
-	read_data = shift_in();						// shift in data from FMCON
-  }
-  while(read_data & 0x80);						// check for done status MSB     
-}
-
-//***************************************************************************
-//* crc_global()
-//* Input(s) : none.
-//* Returns : none.
-//* Description : function to read the global CRC
-//***************************************************************************
-void crc_global(void)
-{
-  unsigned char read_data = 0;					// declare local read_data variable
-  unsigned char crc_index = 0;					// declare local crc_index variable
-  shift_out(WR_FMCON);							// write to FMCON
-  shift_out(CRC_G);								// write global CRC command
-  do
-  {
-    shift_out(RD_FMCON);						// read FMCON command
-	read_data = shift_in();						// shift in data from FMCON
-  }	
-  while(read_data & 0x80);						// check for done status MSB
-  for(crc_index = 0; crc_index < 4; crc_index++)// read 4 CRC bytes
-  {
-    shift_out(RD_FMDATA_I);						// write read data and increment command    
-    data_bytes[crc_index] = shift_in();			// read CRC bytes
-  }    
-}
-
-//***************************************************************************
-//* crc_sector()
-//* Input(s) : none.
-//* Returns : none.
-//* Description : function to read the CRC of a sector
-//***************************************************************************
-void crc_sector(void)
-{
-  unsigned char read_data = 0;					// declare local read_data variable
-  unsigned char crc_index = 0;					// declare local crc_index variable
-  shift_out(WR_FMADRH);							// write address high command
-  shift_out(data_bytes[0]);						// write address stripped form the isp command
-  shift_out(WR_FMCON);							// write to FMCON
-  shift_out(CRC_S);								// write sector CRC command
-  do
-  {
-    shift_out(RD_FMCON);						// read FMCON command
-	read_data = shift_in();						// shift in data from FMCON
-  }
-  while(read_data & 0x80);						// check for done status MSB
-  for(crc_index = 0; crc_index < 4; crc_index++)// read 4 CRC bytes
-  {
-    shift_out(RD_FMDATA_I);						// write read data and increment command    
-    data_bytes[crc_index] = shift_in();			// read CRC bytes
-  }  
-}
-
-//***************************************************************************
-//* read_config()
-//* Input(s) : none.
-//* Returns : none.
-//* Description : function to read from the configuration space
-//***************************************************************************
-void read_config(void)
-{
-  shift_out(WR_FMCON);							// write to FMCON
-  shift_out(CONF);								// write acces config command
-  shift_out(WR_FMADRL);							// write address low command
-  shift_out(data_bytes[0]);						// write address stripped from the isp command
-  shift_out(RD_FMDATA);							// read FMDATA command
-  data_bytes[0] = shift_in();					// read config
-}
-
-//***************************************************************************
-//* write_config()
-//* Input(s) : none.
-//* Returns : none.
-//* Description : function to write to the configuration space
-//***************************************************************************
-void write_config(void)
-{
-  unsigned char read_data = 0;
-  if(data_bytes[0] == 0x10)
-  {
-    shift_out(WR_FMCON);						// write to FMCON
-    shift_out(CCP);								// write clear config protection
-    shift_out(WR_FMDATA);						// write FMDATA command
-    shift_out(CLR_CCP_KEY);						// wirte clear config protection key command
-    do											// loop while status is busy
-    {
-      shift_out(RD_FMCON);						// read FMCON command
-	  read_data = shift_in();					// shift in data from FMCON
-    }
-    while(read_data & 0x80);					// check for done status MSB     
-  }
-  else
-  {
-    shift_out(WR_FMCON);						// write to FMCON
-    shift_out(CONF);							// write acces config command
-    shift_out(WR_FMADRL);						// write address low command
-    shift_out(data_bytes[0]);					// write address stripped from the isp command
-    shift_out(WR_FMDATA);						// write FMDATA command
-    shift_out(data_bytes[1]);					// wirte value stripped from the isp command
-    do											// loop while status is busy
-    {
-      shift_out(RD_FMCON);						// read FMCON command
-	  read_data = shift_in();					// shift in data from FMCON
-    }
-    while(read_data & 0x80);					// check for done status MSB 
-  }    
-}
-
-//***************************************************************************
-//* echo()
-//* Input(s) : none.
-//* Returns : character read from ISP record.
-//* Description : check if in ICP mode
-//***************************************************************************
-unsigned char echo()
-{
-  unsigned char ch;
-  while(!R8_UART1_RFC); // wait until reception is complete	
-  ch = UART1_RecvByte();															// read UART buffer		
-  while(R8_UART1_TFC);	// wait until previous transmission is complete
-	UART1_SendByte(ch);																	// send character
-  if (ch&0x40)	ch&=0xDF;						// if character, then make it upper case
-  return ch;
-}
-
-//***************************************************************************
-//* get2()
-//* Input(s) : none.
-//* Returns : byte read from the ISP record.
-//* Description : check if in ICP mode
-//***************************************************************************
-unsigned char get2()
-{
-  unsigned char record_byte;		
-  record_byte = ascii_to_hex(echo())<<4;		// read high nibble
-  record_byte += ascii_to_hex(echo());			// read low nibble
-  checksum -= record_byte;						// update checksum
-  return record_byte;							// return byte
-}
-
-//***************************************************************************
-//* ascii_to_hex()
-//* Input(s) : character in ascii format
-//* Returns : character in hex format
-//* Description : converts ascii to hex
-//***************************************************************************
-unsigned char ascii_to_hex(unsigned char ch)
-{
-  if (ch & 0x40)								// convert ASCII character
-  {	
-    ch += 0x09;
-  }
-  ch &= 0x0F;									// into 2 digit Hex
-  return ch;
-}
-
-//***************************************************************************
-//* print_hex_to_ascii()
-//* Input(s) : character
-//* Returns : none.
-//* Description : converts hex to ascii and print the character to the UART
-//***************************************************************************
-void print_hex_to_ascii(unsigned char ch)
-{
-  char temp_character;
-  temp_character = ch;
-  temp_character >>= 4;							// get highest nible
-  temp_character &= 0x0F;						// save lower nibble
-  if (temp_character >= 10)						// check if A-F
-  {
-    temp_character += 7;						// offset for A-F
-  }
-  temp_character += 0x30;						// add '0' to get ascii
-  printf("%c", temp_character);					// print upper nible
-  temp_character = ch;
-  temp_character &= 0x0F;						// save lower nibble
-  if (temp_character >= 10)						// check if A-F
-  {
-    temp_character += 7;						// offset for A-F
-  }
-  temp_character += 0x30;						// add '0' to get ascii
-  printf("%c", temp_character);					// print lower nible
-}
-
-//***************************************************************************
-//* program_record()
-//* Input(s) : none.
-//* Returns : none.
-//* Description : function to program bytes from hex record
-//* 				Warning the hex file records need to be page aligned 
-//***************************************************************************
-void program_record(void)		 				
-{
-  char index;
-  for(index = 0; index < nbytes; index++)		// program all individual bytes
-  {
-    program_byte = data_bytes[index];			// get byte to be programmed
-    program();									// program the byte
-    address_low++;								// update address for programmed byte
-    if(address_low == 0x00)						// check if low address rolls over
-    {
-      address_high += 1;						// then increment high address
-    }   
-  }    
-}
-
+//***************************************************************************
+//* 								ISP_to_ICP_bridge.c 
+//*	By : Bauke Siderius		
+//*	Discription : ISP/ICP gateway code for LPC900 programmer using MCB900 
+//*
+//***************************************************************************
+//* Versions
+//***************************************************************************
+//*
+//* v1.7	October 2026
+//*			Program whole aligned pages with a single LOAD/PROG cycle.
+//*			Coalesce consecutive program records into full pages, in window mode.
+//*			Unrolled direct register shift_out()/shift_in() kernels.
+//*			Optional SPI0 clocked ICP transport.
+//*			ICP clock calibration at session start, ICP_CLOCK record.
+//*			Flash commands finish in the background, FMCON polled on TMR2.
+//*			Two slot record pipeline, ok sent when the target is done.
+//*			Interrupt driven UART1 with receive and transmit ring buffers.
+//*			LOAD_BAUD record, falls back to the old rate without a reply.
+//*			Autobaud on the ':' of a record, measured with TMR0 capture.
+//*			No echo mode, MISC_WRITE sub-function 0x20.
+//*			Replies put together in a buffer and queued in one go, no printf.
+//*			Table driven hex decoder, bad characters and long records refused.
+//*			Binary framed protocol with CRC-16, MISC_WRITE sub-function 0x21.
+//*			Window mode, replies carry sequence and credits, sub-function 0x22.
+//*			COMPRESSED record, RLE and LZ decoded into the page buffer.
+//*			Erased bytes are not programmed on pages erased in the session.
+//*			READ_FLASH record, read back as hex records or a binary frame.
+//*			BLANK_CHECK record, only the first programmed address is sent.
+//*			GPIO, UART1, TMR2 and delays behind hal.h, host build in Host/.
+//*			Last page programmed when only line ends follow the last record.
+//*			ICP bus counters per operation, MISC_READ sub-function 0x20.
+//*			Latency histograms on SysTick, MISC_READ sub-function 0x21.
+//*
+//* v1.6	October 2005
+//*			Fixed the program command, a load command has to be given before
+//*	  		putting Data in FM_DATA
+//*
+//* v1.5	September 2005
+//*			Added support for the Clear Configuration Protection	
+//*
+//* v1.4 	December 2004
+//*			Erase sector and erase page fix.
+//*
+//* v1.3	March 2004
+//*			Increased data buffer size to 64 to support LPC92x in FlashMagic.	
+//*
+//* v1.2	August 2003
+//*			Added a delay before entering ICP.	
+//*
+//* v1.1 	August 2003
+//*			Put ports in input only when not in use.
+//*			Fixed CRC read out.
+//*
+//* v1.0 	May 2003
+//* 		Initial version.
+//*
+//***************************************************************************
+#include "hal.h"
+#include "progdef.h"
+#include "icp_spi.h"
+#include "isp_uart.h"
+#include "isp_binary.h"
+#include "isp_unpack.h"
+#include "icp_stats.h"
+#include "isp_latency.h"
+
+//***************************************************************************
+//* variables used for passing parameters
+//***************************************************************************
+unsigned char reg7;
+unsigned char pda_output = 1;					// PDA direction cache, 1 = output
+volatile unsigned char icp_busy = 0;			// a flash command is still running
+unsigned long icp_poll_interval;				// TMR2 cycles between FMCON polls
+unsigned char icp_half_period = ICP_CLOCK_DEFAULT;	// delay loops per PCL half period
+unsigned char icp_clock = ICP_CLOCK_DEFAULT;	// ICP clock setting in use
+unsigned char icp_clock_limit = ICP_CLOCK_DEFAULT;	// fastest setting that read back stable
+//***************************************************************************
+//* record pipeline, one record is received while the other waits for or
+//* is being clocked into the target
+//***************************************************************************
+isp_record records[RECORD_SLOTS];				// received records
+unsigned char rx_slot = 0;						// slot being received
+unsigned char pending_slot = 0;					// slot waiting for the target
+unsigned char record_pending = 0;				// pending_slot holds a record
+unsigned char ack_pending = 0;					// ok messages waiting for the target
+unsigned char ack_sequence[ACK_SLOTS];			// their sequence numbers, oldest first
+unsigned char page_acks = 0;					// last ones, for records still in the page buffer
+unsigned char rx_sequence = 0;					// sequence number of the next record
+//***************************************************************************
+//* buffers for read record
+//***************************************************************************
+unsigned char address_low = 0;					// low address
+unsigned char address_high = 0;					// high address
+unsigned char checksum = 0;						// checksum
+unsigned char nbytes = 0;						// number of data bytes
+unsigned char record_type = 0;					// record type
+unsigned char *data_bytes = records[0].data;	// data of the record being carried out
+unsigned char program_byte;						// byte to be programmed
+unsigned char hex_error = 0;					// a non hex character was read
+unsigned char isp_echo = 1;						// echo received characters, as Flash Magic expects
+//***************************************************************************
+//* hex decoder table
+//***************************************************************************
+const unsigned char hex_values[256] =		// ascii to nibble, HEX_BAD for anything else
+{
+  HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD,
+  HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD, HEX_BAD
+};
+
+//***************************************************************************
+//* page assembly buffer for program records
+//***************************************************************************
+unsigned char page_bytes[ICP_PAGE_SIZE];		// page being assembled
+unsigned char page_high = 0;					// high address of the page
+unsigned char page_low = 0;						// low address of the page, page aligned
+unsigned char page_start = 0;					// offset of first valid byte in page
+unsigned char page_end = 0;						// offset after last valid byte in page
+//***************************************************************************
+//* pages erased in this session and not programmed since, a bit per page
+//***************************************************************************
+unsigned char erased_pages[ICP_PAGES / 8];
+
+//***************************************************************************
+//* init()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : initialization of P89LPC932
+//***************************************************************************
+void init(void)
+{
+	/* GPIO for ICP and UART */
+	hal_pins_init();
+
+	/* SysTick time base for the latency histograms */
+	hal_time_init();
+
+	/* ISP UART */
+	isp_uart_init(ISP_BAUD_DEFAULT);
+
+	/* Timer for the background FMCON poll */
+	hal_poll_init();
+#if ICP_SPI0
+	/* SPI0 for the ICP bus */
+	icp_spi_init();
+#endif
+}
+
+//***************************************************************************
+//* main()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : main loop
+//***************************************************************************
+int main(void)
+{
+	unsigned int idle;
+  init();
+  msec(500);									// delay 500 msec to sabalize before entering ICP mode
+  enter_icp();									// go into ICP mode
+#if ICP_CALIBRATE
+  icp_calibrate();								// run the bus as fast as the wiring allows
+  LAT_OP_END();
+#endif
+  while(1)										// HexFile Loader
+  {		
+    if((page_end != page_start) || record_pending)	// program data still being assembled
+    {
+      for(idle = 0; (idle < PAGE_IDLE_FLUSH) && !record_waiting(); idle++)
+      {
+        pipeline_service();
+        if(page_acks && !record_pending && !isp_window)	// a stop and wait host waits for the ok
+        {
+          break;
+        }
+        HAL_WAIT_US(100);						// wait for the next record
+      }
+      if(!record_waiting() && !record_pending)		// host went quiet, program what we have
+      {
+        page_flush();
+      }
+    }
+    if(isp_binary)								// binary frames instead of hex records
+    {
+      bin_service();
+      continue;
+    }
+    if(!receive_record(&records[rx_slot]))		// read and check the next record
+    {
+      pipeline_drain();							// keep replies in record order
+      isp_reply_sequence = records[rx_slot].sequence;
+      isp_reply('X');							// print error message					
+      continue;									// restart HexLoader
+    }
+    pipeline_queue();							// hand the record to the pipeline
+  }	
+}
+
+//***************************************************************************
+//* receive_record()
+//* Input(s) : record, slot to receive into.
+//* Returns : 1 when the checksum is correct, 0 otherwise.
+//* Description : function to read one hex record from the ISP UART, the
+//*				pipeline keeps running while it waits for characters.
+//*				A record that does not fit the buffer or holds a non hex
+//*				character is given up at once, the rest of it is skipped
+//*				while waiting for the next ':'
+//***************************************************************************
+unsigned char receive_record(isp_record *record)
+{
+  unsigned char index;
+  unsigned long start;
+  checksum = 0;									// clear checksum before loading file
+  hex_error = 0;
+  while(echo() != ':');							// record starts with a ':'	
+  start = LAT_NOW();
+  record->sequence = rx_sequence++;				// numbered for window mode
+  record->nbytes = get2();						// get number of bytes in record
+  if(hex_error || (record->nbytes > ICP_PAGE_SIZE))	// would overrun the data buffer
+  {
+    return 0;
+  }
+  record->address_high = get2();				// get MSB of load address
+  record->address_low = get2();					// get LSB of load address
+  record->record_type = get2();					// get record type
+  for(index=0; (index < record->nbytes) && !hex_error; index++)	// read record data to buffer
+  {
+    record->data[index] = get2();				// put databytes in an array
+  }
+  if(hex_error)									// stop at the first bad character
+  {
+    return 0;
+  }
+  reg7 = checksum;								// put calculated checksum in reg7
+  if((reg7 != get2()) || hex_error)				// read and check checksum on record
+  {
+    return 0;
+  }
+  record->received = LAT_RECEIVED(record->record_type, start);
+  return 1;
+}
+
+//***************************************************************************
+//* pipeline_service()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to move the record pipeline along. The ok for
+//*				a flash command is sent once the target is done with it,
+//*				then the next received record is handed to the target.
+//*				The oks of records still in the page buffer wait for the
+//*				page, they don't hold up the next record
+//***************************************************************************
+void pipeline_service(void)
+{
+  unsigned char index;
+  while((ack_pending > page_acks) && !icp_busy)	// flash command finished
+  {
+    isp_reply_sequence = ack_sequence[0];
+    isp_reply('.');							// send ok message
+    ack_pending--;
+    for(index = 0; index < ack_pending; index++)
+    {
+      ack_sequence[index] = ack_sequence[index + 1];
+    }
+  }
+  if(record_pending && (ack_pending == page_acks) && !icp_busy)
+  {
+    record_pending = 0;
+    dispatch_record(&records[pending_slot]);
+  }
+}
+
+//***************************************************************************
+//* pipeline_queue()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to hand the record in rx_slot to the pipeline.
+//*				Records that may change the link are carried out before
+//*				the next record is read
+//***************************************************************************
+void pipeline_queue(void)
+{
+  while(record_pending)							// wait until the other slot is taken
+  {
+    pipeline_service();
+    HAL_IDLE();
+  }
+  pending_slot = rx_slot;
+  record_pending = 1;
+  rx_slot ^= 1;									// receive the next one in the other slot
+  pipeline_service();
+  if((records[pending_slot].record_type == MISC_WRITE) || (records[pending_slot].record_type == LOAD_BAUD))
+  {
+    while(record_pending || ack_pending)
+    {
+      pipeline_service();
+      HAL_IDLE();
+    }
+  }
+}
+
+//***************************************************************************
+//* pipeline_drain()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to carry out the pending record and send every
+//*				ok still owed, the page buffer is programmed so the oks
+//*				of its records can go too
+//***************************************************************************
+void pipeline_drain(void)
+{
+  while(record_pending)
+  {
+    pipeline_service();
+    HAL_IDLE();
+  }
+  page_flush();
+  while(ack_pending)
+  {
+    pipeline_service();
+    HAL_IDLE();
+  }
+}
+
+//***************************************************************************
+//* ack_queue()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to queue the ok for the record isp_reply_sequence
+//*				is set for. It goes out once the target is done, or once
+//*				the page buffer is programmed when the record left bytes
+//*				in it. Records without data add oks but no bytes, so with
+//*				every slot taken the page is programmed and the oks sent
+//***************************************************************************
+void ack_queue(void)
+{
+  unsigned char sequence = isp_reply_sequence;
+  if(ack_pending == ACK_SLOTS)					// no room for this ok
+  {
+    pipeline_drain();
+    isp_reply_sequence = sequence;
+  }
+  ack_sequence[ack_pending++] = isp_reply_sequence;
+  if(page_end != page_start)					// last bytes not in the target yet
+  {
+    page_acks++;
+  }
+}
+
+//***************************************************************************
+//* dispatch_record()
+//* Input(s) : record, a received record with a correct checksum.
+//* Returns : none.
+//* Description : function to carry out an ISP record
+//***************************************************************************
+void dispatch_record(isp_record *record)
+{
+  if((record->record_type != PROGRAM) && (record->record_type != COMPRESSED))	// any other record ends the page
+  {
+    pipeline_drain();							// oks of the page go first
+  }
+  address_high = record->address_high;			// the ICP functions work on these,
+  address_low = record->address_low;			// page_flush() has used them too
+  nbytes = record->nbytes;
+  record_type = record->record_type;
+  data_bytes = record->data;
+  isp_reply_sequence = record->sequence;		// replies and the ok are for this record
+  LAT_RECORD_BEGIN(record_type, record->received);
+  switch(record_type)							// switch on record type
+  {
+    case PROGRAM:								// program record type
+    {
+      program_record();						//
+      ack_queue();							// send ok message once programmed
+      break;
+    }
+    case COMPRESSED:							// compressed program record type
+    {
+      if(unpack_record(((unsigned int)address_high << 8) | address_low, data_bytes, nbytes))
+      {
+        ack_queue();							// send ok message once programmed
+      }
+      else
+      {
+        pipeline_drain();						// oks of the page go first
+        isp_reply_sequence = record->sequence;
+        isp_reply('R');						// broken stream, send error message
+      }
+      break;
+    }
+    case READ_FLASH:							// read back record type
+    {
+      read_flash();							// sends its own reply
+      break;
+    }
+    case BLANK_CHECK:							// blank check record type
+    {
+      blank_check();							// sends its own reply
+      break;
+    }
+    case READ_VERSION:						// read version record type
+    {
+      isp_reply_hex(ISP_VERSION);		// send ISP version
+      isp_reply_hex(ICP_VERSION);		// send ICP version
+      isp_reply('.');							// send ok message     
+      break;
+    }
+    case ICP_CLOCK:							// ICP clock record type
+    {
+      isp_reply_hex(icp_clock);			// send clock setting in use
+      isp_reply_hex(icp_clock_limit);		// send fastest stable setting
+      isp_reply('.');							// send ok message
+      break;
+    }
+    case MISC_WRITE:							// misc write record type
+    { 
+      if(data_bytes[0] == MISC_ECHO)			// bridge echo control
+      {
+        isp_echo = (data_bytes[1] != 0);
+        isp_reply('.');						// send ok message
+        break;
+      }
+      if(data_bytes[0] == MISC_BINARY)			// bridge protocol switch
+      {
+        isp_reply('.');						// ok in the protocol it came in
+        isp_binary = (data_bytes[1] != 0);
+        break;
+      }
+      if(data_bytes[0] == MISC_WINDOW)			// windowed replies
+      {
+        isp_window = (data_bytes[1] != 0);
+        isp_reply('.');						// already in the new format
+        rx_sequence = 0;						// next record is number 0
+        break;
+      }
+      write_config();							// write config byte
+      ack_queue();							// send ok message once written
+      break;
+    }
+    case MISC_READ:							// misc read record type
+    {
+      if(data_bytes[0] == MISC_ICP_STATS)		// bridge bus counters
+      {
+        icp_stats_report((nbytes > 1) && data_bytes[1]);	// sends its own reply
+        break;
+      }
+      if(data_bytes[0] == MISC_LATENCY)			// bridge latency histograms
+      {
+        latency_report((nbytes > 1) && data_bytes[1], (nbytes > 2) ? data_bytes[2] : 0);	// sends its own reply
+        break;
+      }
+      read_config();							// read config byte
+      isp_reply_hex(data_bytes[0]);		// send config byte in ascii
+      isp_reply('.');							// send ok message
+      break;
+    }
+    case ERASE:								// erase record type
+    {
+      if(data_bytes[0] == 0)					// check if dbytes[0] indicates page erase
+      {
+        erase_page();							// try erase a page and get status
+        ack_queue();							// send ok message once erased
+      }  
+      else if(data_bytes[0] == 1)				// check if dbytes[0] indicates sector erase
+      {
+        erase_sector();						// try erase a sector and get status
+        ack_queue();							// send ok message once erased
+      }
+      else
+      {
+        isp_reply('R');						// send error message
+      }
+      break;
+    }
+    case SECTOR_CRC:							// sector CRC record type
+    {
+      crc_sector();							// try sector CRC and get status
+      isp_reply_hex(data_bytes[3]);		// send first CRC in ascii
+      isp_reply_hex(data_bytes[2]);		// send second CRC in ascii
+      isp_reply_hex(data_bytes[1]);		// send third CRC in ascii
+      isp_reply_hex(data_bytes[0]);		// send fourth CRC in ascii
+      isp_reply('.');							// send ok message
+      break;
+    }
+    case GLOBAL_CRC:
+    {  	
+      crc_global();
+      isp_reply_hex(data_bytes[3]);		// send first CRC in ascii
+      isp_reply_hex(data_bytes[2]);		// send second CRC in ascii
+      isp_reply_hex(data_bytes[1]);		// send third CRC in ascii
+      isp_reply_hex(data_bytes[0]);		// send fourth CRC in ascii
+      isp_reply('.');							// send ok message
+      break;
+    }
+    case LOAD_BAUD:							// load baud rate record type
+    {
+      load_baud();							// sends its own reply
+      break;
+    }
+    case CHIP_ERASE:							// chip erase record type	
+    {
+      erase_global();							// try erase global and get status
+      ack_queue();							// send ok message once erased
+      break;
+    }
+    default:									// incorrect record type	
+    {
+      isp_reply('R');							// send error message
+      break;
+    }	  
+  }
+  LAT_RECORD_END();
+}
+
+//***************************************************************************
+//* enter_icp()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to pulse reset to enter ICP mode
+//***************************************************************************
+void enter_icp(void)
+{	
+  char pulses = 0;
+
+	/* Power off target */
+	HAL_PIN_CLEAR(ICP_VCC | ICP_RESET);
+	msec(10);
+	/* Power on target with reset held low */
+	HAL_PIN_SET(ICP_VCC);
+	msec(5);
+  for(pulses = 0; pulses < 7; pulses++)			// pulse reset 7 times
+  {
+    HAL_PIN_SET(ICP_RESET);
+    HAL_DELAY_US(30);		// wait about 15 usec
+		HAL_PIN_CLEAR(ICP_RESET);
+    HAL_DELAY_US(30);		// wait about 15 usec
+  }
+  HAL_PIN_SET(ICP_RESET);									// hold reset high
+}
+
+#if !ICP_SPI0
+//***************************************************************************
+//* ICP bit kernels
+//* PCL and PDA live in PA[7:0], so every edge is a single byte store to the
+//* port with the other pins taken from a copy made at the start of the byte.
+//* Each bit takes the same number of cycles whatever its value, and
+//* ICP_DELAY() pads every half period with icp_half_period loops.
+//***************************************************************************
+#define ICP_OUT_BIT(n)												\
+  port = idle | (((data >> (n)) & 0x01) << ICP_PDA_BIT);			\
+  HAL_PORT_WRITE(port);						/* clock low, set data */	\
+  ICP_DELAY();														\
+  HAL_PORT_WRITE(port | ICP_PCL);			/* clock databit */		\
+  ICP_DELAY()
+
+#define ICP_IN_BIT(n)												\
+  HAL_PORT_WRITE(idle | ICP_PCL);			/* clock out databit */	\
+  ICP_DELAY();														\
+  data |= ((HAL_PORT_READ() >> ICP_PDA_BIT) & 0x01) << (n);		\
+  HAL_PORT_WRITE(idle);						/* hold clock line low */	\
+  ICP_DELAY()
+
+//***************************************************************************
+//* shift_out()
+//* Input(s) : data_byte.
+//* Returns : none.
+//* Description : function to shift out data to the part being programmed
+//***************************************************************************
+void shift_out(char data_byte)
+{
+  unsigned char data = data_byte;
+  unsigned char idle;
+  unsigned char port;
+  unsigned char delay;
+  idle = HAL_PORT_LEVELS() & (unsigned char)~(ICP_PCL | ICP_PDA);	// state of the other pins
+  if(!pda_output)								// turn PDA around only when needed
+  {
+    HAL_PDA_DRIVE();
+    pda_output = 1;
+    ICP_STAT_TURN();
+  }
+  ICP_STAT_OUT();
+  ICP_OUT_BIT(0);								// shift out 8 bits, LSB first
+  ICP_OUT_BIT(1);
+  ICP_OUT_BIT(2);
+  ICP_OUT_BIT(3);
+  ICP_OUT_BIT(4);
+  ICP_OUT_BIT(5);
+  ICP_OUT_BIT(6);
+  ICP_OUT_BIT(7);
+  HAL_PORT_WRITE(idle | ICP_PDA | ICP_PCL);		// hold data and clock high after transfer
+}	
+
+//***************************************************************************
+//* shift_in()
+//* Input(s) : none.
+//* Returns : Data shifted back from part that is being programmed.
+//* Description : function read data from the part being programmed
+//***************************************************************************
+char shift_in(void)
+{
+  unsigned char data = 0;
+  unsigned char idle;
+  unsigned char delay;
+  idle = HAL_PORT_LEVELS() & (unsigned char)~(ICP_PCL | ICP_PDA);	// state of the other pins
+  HAL_PORT_WRITE(idle);							// clock low before releasing PDA
+  if(pda_output)								// turn PDA around only when needed
+  {
+    HAL_PDA_RELEASE();
+    pda_output = 0;
+    ICP_STAT_TURN();
+  }
+  ICP_DELAY();									// full low half period before the first bit
+  ICP_STAT_IN();
+  ICP_IN_BIT(0);								// shift in 8 bits, LSB first
+  ICP_IN_BIT(1);
+  ICP_IN_BIT(2);
+  ICP_IN_BIT(3);
+  ICP_IN_BIT(4);
+  ICP_IN_BIT(5);
+  ICP_IN_BIT(6);
+  ICP_IN_BIT(7);
+  HAL_PORT_WRITE(idle | ICP_PDA);				// dataline latch high for next shift_out
+  return data;									// return clocked in byte
+}
+#endif
+
+//***************************************************************************
+//* icp_set_clock()
+//* Input(s) : setting, delay loops per half period or SPI0 divider.
+//* Returns : none.
+//* Description : function to set the ICP clock rate
+//***************************************************************************
+void icp_set_clock(unsigned char setting)
+{
+#if ICP_SPI0
+  hal_spi_clock(setting);						// PCL = Fsys / setting
+#else
+  icp_half_period = setting;					// padding of every PCL half period
+#endif
+  icp_clock = setting;
+}
+
+//***************************************************************************
+//* icp_calibrate()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to find the fastest stable ICP clock. Starting
+//*				from ICP_CLOCK_SLOW the clock is stepped up while FMCON and
+//*				UCFG1 keep reading back the same as at the slowest rate,
+//*				then ICP_CLOCK_MARGIN steps are given back as a safety margin
+//***************************************************************************
+void icp_calibrate(void)
+{
+  unsigned char setting;
+  unsigned char reads;
+  unsigned char fmcon_ref;
+  unsigned char config_ref;
+  unsigned char failed = 0;
+  ICP_STAT_OP(ICP_OP_OTHER);
+  LAT_OP_BEGIN(ICP_OP_OTHER);
+  icp_set_clock(ICP_CLOCK_SLOW);				// reference values at the slowest rate
+  config_ref = calibrate_read(RD_FMDATA);		// FMCON is always read after a CONF access
+  fmcon_ref = calibrate_read(RD_FMCON);
+  icp_clock_limit = ICP_CLOCK_SLOW;
+  for(setting = ICP_CLOCK_SLOW; setting > ICP_CLOCK_FAST; )
+  {
+    setting--;									// one step faster
+    icp_set_clock(setting);
+    for(reads = 0; reads < ICP_CLOCK_READS; reads++)
+    {
+      if((calibrate_read(RD_FMDATA) != config_ref) ||
+         (calibrate_read(RD_FMCON) != fmcon_ref))
+      {
+        break;									// reads are no longer stable
+      }
+    }
+    if(reads < ICP_CLOCK_READS)
+    {
+      failed = 1;
+      break;
+    }
+    icp_clock_limit = setting;					// this rate is still stable
+  }
+  if(failed)									// the target may have lost bit sync
+  {
+    enter_icp();
+  }
+  if(icp_clock_limit > (ICP_CLOCK_SLOW - ICP_CLOCK_MARGIN))
+  {
+    icp_set_clock(ICP_CLOCK_SLOW);
+  }
+  else
+  {
+    icp_set_clock(icp_clock_limit + ICP_CLOCK_MARGIN);
+  }
+}
+
+//***************************************************************************
+//* calibrate_read()
+//* Input(s) : opcode, RD_FMCON or RD_FMDATA for UCFG1.
+//* Returns : byte read from the part.
+//* Description : function to read FMCON or the UCFG1 config byte
+//***************************************************************************
+unsigned char calibrate_read(unsigned char opcode)
+{
+  if(opcode == RD_FMDATA)						// select UCFG1 in the config space
+  {
+    shift_out(WR_FMCON);						// write to FMCON
+    shift_out(CONF);							// write acces config command
+    shift_out(WR_FMADRL);						// write address low command
+    shift_out(0x00);							// UCFG1
+  }
+  shift_out(opcode);
+  return shift_in();
+}
+
+//***************************************************************************
+//* icp_sync()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to wait until the flash command left running in
+//*				the background is done
+//***************************************************************************
+void icp_sync(void)
+{
+  unsigned long start;
+  if(icp_busy)
+  {
+    start = LAT_NOW();
+    while(icp_busy)								// TMR2 polls FMCON until done
+    {
+      HAL_IDLE();
+    }
+    LAT_BUSY_WAIT(start);						// charged to the record being carried out
+  }
+}
+
+//***************************************************************************
+//* icp_busy_start()
+//* Input(s) : expected, nominal duration of the command in usec.
+//* Returns : none.
+//* Description : function to hand a flash command that was just started to
+//*				the background poll. FMCON is first read after the expected
+//*				duration and then every 1/ICP_POLL_DIVIDER of it, so the
+//*				bus is left alone while the target is surely busy
+//***************************************************************************
+void icp_busy_start(unsigned long expected)
+{
+  unsigned long interval;
+  interval = expected / ICP_POLL_DIVIDER;
+  if(interval < ICP_POLL_MIN)
+  {
+    interval = ICP_POLL_MIN;
+  }
+  icp_poll_interval = ICP_US(interval);
+  LAT_FLASH_START();
+  icp_busy = 1;
+  HAL_POLL_START(ICP_US(expected));				// first poll after the expected time
+}
+
+//***************************************************************************
+//* TMR2_IRQHandler()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : background FMCON poll, stops the tick once the target is
+//*				no longer busy
+//***************************************************************************
+void TMR2_IRQHandler(void)
+{
+  HAL_POLL_ACK();
+  HAL_POLL_RELOAD(icp_poll_interval);			// poll faster from now on
+  ICP_STAT_POLL();
+  shift_out(RD_FMCON);							// read FMCON command
+  if(!(shift_in() & 0x80))						// check for done status MSB
+  {
+    HAL_POLL_STOP();
+    icp_busy = 0;
+    LAT_FLASH_DONE();
+  }
+}
+
+//***************************************************************************
+//* program()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : funtion to program the page register into Flash
+//***************************************************************************
+void program(void)
+{
+  icp_sync();								// wait for the bus and the previous command
+  ICP_STAT_OP(ICP_OP_PROGRAM);
+  LAT_OP_BEGIN(ICP_OP_PROGRAM);
+  shift_out(WR_FMADRL);							// write address low command page aligned
+  shift_out(address_low);						// write address from the isp command
+  shift_out(WR_FMADRH);							// write address high command
+  shift_out(address_high);						// write address from the isp command
+  shift_out(WR_FMCON);							// write to FMCON
+  shift_out(LOAD);								// load commmand 
+  shift_out(WR_FMDATA);							// write to FMDATA
+  shift_out(program_byte);						// load databyte
+  shift_out(WR_FMCON);							// write to FMCON
+  shift_out(PROG);								// program commmand
+  icp_busy_start(ICP_TIME_PROG);				// FMCON is polled in the background
+}
+
+//***************************************************************************
+//* program_page()
+//* Input(s) : page_data, ICP_PAGE_SIZE bytes, start, end, offsets of the
+//*			bytes to be programmed.
+//* Returns : none.
+//* Description : function to load the page register and program it with
+//*				a single PROG, address must be page aligned. Bytes outside
+//*				start to end are not loaded and keep their Flash contents
+//***************************************************************************
+void program_page(unsigned char *page_data, unsigned char start, unsigned char end)
+{
+  unsigned char index;
+  icp_sync();								// wait for the bus and the previous command
+  ICP_STAT_OP(ICP_OP_PAGE);
+  LAT_OP_BEGIN(ICP_OP_PAGE);
+  ICP_BURST_BEGIN();							// the page is sent as one write-only burst
+  ICP_BURST(WR_FMADRL);							// write address low command
+  ICP_BURST(address_low + start);				// first byte to load
+  ICP_BURST(WR_FMADRH);							// write address high command
+  ICP_BURST(address_high);						// write address from the isp command
+  ICP_BURST(WR_FMCON);							// write to FMCON
+  ICP_BURST(LOAD);								// load command, clears the page register
+  for(index = start; index < end; index++)		// stream the bytes into the page register
+  {
+    ICP_BURST(WR_FMDATA_I);						// write FMDATA and increment address
+    ICP_BURST(page_data[index]);				// load databyte
+  }
+  ICP_BURST(WR_FMCON);							// write to FMCON
+  ICP_BURST(PROG);								// program commmand, one cycle per page
+  ICP_BURST_END();
+  icp_busy_start(ICP_TIME_PROG);				// FMCON is polled in the background
+}
+
+//***************************************************************************
+//* erase_global()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to erase all Flash and config
+//***************************************************************************
+void erase_global(void)
+{
+  char index, dummy;
+  icp_sync();								// wait for the bus and the previous command
+  ICP_STAT_OP(ICP_OP_ERASE_G);
+  LAT_OP_BEGIN(ICP_OP_ERASE_G);
+  shift_out(WR_FMCON);							// write FMCON command
+  shift_out(ERS_G);								// write erase global command
+  erased_mark(0, ICP_PAGES, 1);					// whole Flash is blank now
+//***************************************************************************
+//* This code must be added due to a bug in erase global
+//* otherwise it will stay busy forever
+//***************************************************************************
+  for(index = 0; index < 50; index++)			// read for about 5ms
+  {
+    shift_out(RD_FMDATA_I);						// read data increment address
+    dummy = shift_in();							// do dummy reads
+  } 
+//***************************************************************************
+//* End added code for erase global bug
+//***************************************************************************
+  icp_busy_start(ICP_TIME_ERS_G);				// FMCON is polled in the background
+}
+
+//***************************************************************************
+//* erase_sector()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to erase a sector in Flash
+//***************************************************************************
+void erase_sector(void)
+{
+  icp_sync();								// wait for the bus and the previous command
+  ICP_STAT_OP(ICP_OP_ERASE_S);
+  LAT_OP_BEGIN(ICP_OP_ERASE_S);
+  shift_out(WR_FMADRH);							// write address high command
+  shift_out(data_bytes[1]);						// write address stripped from the isp command
+  shift_out(WR_FMCON);							// write to FMCON
+  shift_out(ERS_S);								// write erase sector command
+  erased_mark(((unsigned int)data_bytes[1] << 8) / ICP_SECTOR_SIZE * (ICP_SECTOR_SIZE / ICP_PAGE_SIZE),
+              ICP_SECTOR_SIZE / ICP_PAGE_SIZE, 1);
+  icp_busy_start(ICP_TIME_ERS_S);				// FMCON is polled in the background
+}
+
+//***************************************************************************
+//* erase_page()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to erase a page in Flash
+//***************************************************************************
+void erase_page(void)
+{
+  icp_sync();								// wait for the bus and the previous command
+  ICP_STAT_OP(ICP_OP_ERASE_P);
+  LAT_OP_BEGIN(ICP_OP_ERASE_P);
+  shift_out(WR_FMADRL);							// write address low command
+  shift_out(data_bytes[2]);						// write address stripped from the isp command
+  shift_out(WR_FMADRH);							// write address high command
+  shift_out(data_bytes[1]);						// write address stripped form the isp command
+  shift_out(WR_FMCON);							// write to FMCON
+  shift_out(ERS_P);								// write erase page command
+  erased_mark((((unsigned int)data_bytes[1] << 8) | data_bytes[2]) / ICP_PAGE_SIZE, 1, 1);
+  icp_busy_start(ICP_TIME_ERS_P);				// FMCON is polled in the background
+}
+
+//***************************************************************************
+//* crc_global()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to read the global CRC
+//***************************************************************************
+void crc_global(void)
+{
+  unsigned char crc_index = 0;					// declare local crc_index variable
+  icp_sync();								// wait for the bus and the previous command
+  ICP_STAT_OP(ICP_OP_CRC_G);
+  LAT_OP_BEGIN(ICP_OP_CRC_G);
+  shift_out(WR_FMCON);							// write to FMCON
+  shift_out(CRC_G);								// write global CRC command
+  icp_busy_start(ICP_TIME_CRC_G);				// FMCON is polled in the background
+  icp_sync();									// the CRC is needed right away
+  for(crc_index = 0; crc_index < 4; crc_index++)// read 4 CRC bytes
+  {
+    shift_out(RD_FMDATA_I);						// write read data and increment command    
+    data_bytes[crc_index] = shift_in();			// read CRC bytes
+  }    
+}
+
+//***************************************************************************
+//* crc_sector()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to read the CRC of a sector
+//***************************************************************************
+void crc_sector(void)
+{
+  unsigned char crc_index = 0;					// declare local crc_index variable
+  icp_sync();								// wait for the bus and the previous command
+  ICP_STAT_OP(ICP_OP_CRC_S);
+  LAT_OP_BEGIN(ICP_OP_CRC_S);
+  shift_out(WR_FMADRH);							// write address high command
+  shift_out(data_bytes[0]);						// write address stripped form the isp command
+  shift_out(WR_FMCON);							// write to FMCON
+  shift_out(CRC_S);								// write sector CRC command
+  icp_busy_start(ICP_TIME_CRC_S);				// FMCON is polled in the background
+  icp_sync();									// the CRC is needed right away
+  for(crc_index = 0; crc_index < 4; crc_index++)// read 4 CRC bytes
+  {
+    shift_out(RD_FMDATA_I);						// write read data and increment command    
+    data_bytes[crc_index] = shift_in();			// read CRC bytes
+  }  
+}
+
+//***************************************************************************
+//* read_config()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to read from the configuration space
+//***************************************************************************
+void read_config(void)
+{
+  icp_sync();								// wait for the bus and the previous command
+  ICP_STAT_OP(ICP_OP_CONFIG);
+  LAT_OP_BEGIN(ICP_OP_CONFIG);
+  shift_out(WR_FMCON);							// write to FMCON
+  shift_out(CONF);								// write acces config command
+  shift_out(WR_FMADRL);							// write address low command
+  shift_out(data_bytes[0]);						// write address stripped from the isp command
+  shift_out(RD_FMDATA);							// read FMDATA command
+  data_bytes[0] = shift_in();					// read config
+}
+
+//***************************************************************************
+//* read_flash()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to read data_bytes[0..1] bytes, MSB first, from
+//*				the record address. They are sent as hex records of
+//*				READ_LINE bytes, or as the data of one reply frame in
+//*				binary mode, which leaves room for the sequence and
+//*				credits in window mode. Each part is queued as soon as it is read,
+//*				so the UART sends while the next bytes are clocked in
+//***************************************************************************
+void read_flash(void)
+{
+  unsigned int address;
+  unsigned int remaining;
+  unsigned char count;
+  unsigned char line_checksum;
+  unsigned char value;
+  address = ((unsigned int)address_high << 8) | address_low;
+  remaining = ((unsigned int)data_bytes[0] << 8) | data_bytes[1];
+  if((nbytes != 2) || (remaining == 0)
+     || (isp_binary && (remaining > BIN_FRAME_SIZE - (isp_window ? 2 : 0))))	// room for window mode
+  {
+    isp_reply('R');								// send error message
+    return;
+  }
+  icp_sync();									// wait for the bus and the previous command
+  ICP_STAT_OP(ICP_OP_READ);
+  LAT_OP_BEGIN(ICP_OP_READ);
+  shift_out(WR_FMADRL);							// write address low command
+  shift_out(address_low);
+  shift_out(WR_FMADRH);							// write address high command
+  shift_out(address_high);
+  while(remaining)
+  {
+    count = (remaining > READ_LINE) ? READ_LINE : remaining;
+    line_checksum = count + (address >> 8) + address;
+    if(!isp_binary)								// data record header
+    {
+      isp_reply_char(':');
+      isp_reply_hex(count);
+      isp_reply_hex(address >> 8);
+      isp_reply_hex(address);
+      isp_reply_hex(0x00);
+    }
+    remaining -= count;
+    address += count;
+    while(count--)
+    {
+      shift_out(RD_FMDATA_I);					// read data and increment address
+      value = shift_in();
+      line_checksum += value;
+      isp_reply_hex(value);
+    }
+    if(!isp_binary)
+    {
+      isp_reply_hex(-line_checksum);			// two's complement checksum
+      isp_reply_char('\r');
+      isp_reply_char('\n');
+    }
+  }
+  isp_reply('.');								// send ok message
+}
+
+//***************************************************************************
+//* blank_check()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to check data_bytes[0..1] bytes, MSB first, from
+//*				the record address for erased bytes. The reply is only the
+//*				ok when they all are, else the address of the first byte
+//*				that is not followed by the ok. Whole pages found blank
+//*				are marked erased so programming can skip them
+//***************************************************************************
+void blank_check(void)
+{
+  unsigned long address;
+  unsigned long end;
+  unsigned int first_page;
+  unsigned int end_page;
+  address = ((unsigned int)address_high << 8) | address_low;
+  end = address + (((unsigned int)data_bytes[0] << 8) | data_bytes[1]);
+  if((nbytes != 2) || (end == address) || (end > 0x10000))
+  {
+    isp_reply('R');								// send error message
+    return;
+  }
+  first_page = (address + ICP_PAGE_SIZE - 1) / ICP_PAGE_SIZE;
+  icp_sync();									// wait for the bus and the previous command
+  ICP_STAT_OP(ICP_OP_BLANK);
+  LAT_OP_BEGIN(ICP_OP_BLANK);
+  shift_out(WR_FMADRL);							// write address low command
+  shift_out(address_low);
+  shift_out(WR_FMADRH);							// write address high command
+  shift_out(address_high);
+  while(address < end)
+  {
+    shift_out(RD_FMDATA_I);						// read data and increment address
+    if((unsigned char)shift_in() != ICP_ERASED)
+    {
+      break;
+    }
+    address++;
+  }
+  end_page = address / ICP_PAGE_SIZE;			// pages before the first programmed byte
+  if(end_page > first_page)
+  {
+    erased_mark(first_page, end_page - first_page, 1);
+  }
+  if(address < end)
+  {
+    isp_reply_hex(address >> 8);				// first byte that is not blank
+    isp_reply_hex(address);
+  }
+  isp_reply('.');								// send ok message
+}
+
+//***************************************************************************
+//* write_config()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to write to the configuration space
+//***************************************************************************
+void write_config(void)
+{
+  icp_sync();								// wait for the bus and the previous command
+  ICP_STAT_OP(ICP_OP_CONFIG);
+  LAT_OP_BEGIN(ICP_OP_CONFIG);
+  if(data_bytes[0] == 0x10)
+  {
+    shift_out(WR_FMCON);						// write to FMCON
+    shift_out(CCP);								// write clear config protection
+    shift_out(WR_FMDATA);						// write FMDATA command
+    shift_out(CLR_CCP_KEY);						// wirte clear config protection key command
+    icp_busy_start(ICP_TIME_CCP);				// FMCON is polled in the background
+  }
+  else
+  {
+    shift_out(WR_FMCON);						// write to FMCON
+    shift_out(CONF);							// write acces config command
+    shift_out(WR_FMADRL);						// write address low command
+    shift_out(data_bytes[0]);					// write address stripped from the isp command
+    shift_out(WR_FMDATA);						// write FMDATA command
+    shift_out(data_bytes[1]);					// wirte value stripped from the isp command
+    icp_busy_start(ICP_TIME_CONF);				// FMCON is polled in the background
+  }    
+}
+
+//***************************************************************************
+//* load_baud()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to switch the ISP baud rate to data_bytes[0..3],
+//*				MSB first. The ok is sent at the old rate, then the host
+//*				has ISP_BAUD_TIMEOUT msec to start a record (':', or
+//*				BIN_SOF in binary mode) at the new rate, otherwise the
+//*				old rate is restored
+//***************************************************************************
+void load_baud(void)
+{
+  unsigned long baudrate;
+  unsigned short old_divisor;
+  unsigned short new_divisor;
+  short error;
+  unsigned long wait;
+  baudrate = ((unsigned long)data_bytes[0] << 24) | ((unsigned long)data_bytes[1] << 16)
+           | ((unsigned long)data_bytes[2] << 8) | data_bytes[3];
+  old_divisor = HAL_UART_DIVISOR;
+  error = ISP_BAUD_ERROR + 1;
+  if(nbytes == 4)
+  {
+    error = HAL_UART_BAUD(baudrate, ISP_BAUD_ERROR);	// only set when reachable
+  }
+  if((error > ISP_BAUD_ERROR) || (error < -ISP_BAUD_ERROR))
+  {
+    isp_reply('R');							// rate not reachable, send error message
+    return;
+  }
+  new_divisor = HAL_UART_DIVISOR;
+  HAL_UART_DIVISOR = old_divisor;					// reply at the rate the host listens to
+  isp_reply('.');								// send ok message
+  while(!isp_uart_tx_idle())					// wait until the ok has left
+  {
+    HAL_IDLE();
+  }
+  HAL_UART_DIVISOR = new_divisor;
+  isp_uart_rx_flush();
+  isp_uart_status = 0;
+  for(wait = 0; (wait < ISP_BAUD_TIMEOUT * 10UL) && !isp_uart_rx_count(); wait++)
+  {
+    HAL_WAIT_US(100);							// wait for the host at the new rate
+  }
+  if(!isp_uart_rx_count() || isp_uart_status
+     || (isp_uart_peek() != (isp_binary ? BIN_SOF : ':')))
+  {
+    isp_uart_rx_flush();						// no record or garbage, go back
+    HAL_UART_DIVISOR = old_divisor;
+  }
+}
+
+//***************************************************************************
+//* echo()
+//* Input(s) : none.
+//* Returns : character read from ISP record.
+//* Description : check if in ICP mode
+//***************************************************************************
+unsigned char echo()
+{
+  unsigned char ch;
+  while(!isp_uart_rx_count())					// wait until a character is buffered
+  {
+    pipeline_service();							// keep the target busy meanwhile
+    HAL_IDLE();
+  }
+  ch = isp_uart_getc();							// read receive buffer
+  if(isp_echo)
+  {
+    isp_uart_putc(ch);							// queue the echo
+  }
+  return ch;
+}
+
+//***************************************************************************
+//* record_waiting()
+//* Input(s) : none.
+//* Returns : 1 when the start of the next record has been received.
+//* Description : line ends left after the last record are read and echoed
+//*				here, so they don't count as the host still sending
+//***************************************************************************
+unsigned char record_waiting(void)
+{
+  if(isp_binary)
+  {
+    return isp_uart_rx_count() != 0;
+  }
+  while(isp_uart_rx_count() && (isp_uart_peek() != ':'))
+  {
+    echo();
+  }
+  return isp_uart_rx_count() != 0;
+}
+
+//***************************************************************************
+//* get2()
+//* Input(s) : none.
+//* Returns : byte read from the ISP record.
+//* Description : decode two hex digits, hex_error is set when either of
+//*				them is not a hex digit
+//***************************************************************************
+unsigned char get2()
+{
+  unsigned char high_nibble;
+  unsigned char low_nibble;
+  unsigned char record_byte;		
+  high_nibble = hex_values[echo()];				// read high nibble
+  low_nibble = hex_values[echo()];				// read low nibble
+  hex_error |= (high_nibble | low_nibble) & HEX_BAD;
+  record_byte = (high_nibble << 4) | (low_nibble & 0x0F);
+  checksum -= record_byte;						// update checksum
+  return record_byte;							// return byte
+}
+
+//***************************************************************************
+//* program_record()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to add the bytes from a hex record to the page
+//*				assembly buffer
+//***************************************************************************
+void program_record(void)		 				
+{
+  unsigned char index;
+  unsigned int address;
+  address = ((unsigned int)address_high << 8) | address_low;
+  for(index = 0; index < nbytes; index++)		// add all bytes to the page
+  {
+    page_add(address, data_bytes[index]);
+    address = (address + 1) & 0xFFFF;			// next address, wraps like the target
+  }    
+}
+
+//***************************************************************************
+//* page_add()
+//* Input(s) : address, value.
+//* Returns : none.
+//* Description : function to add one byte to the page assembly buffer, a
+//*				page is programmed when it is full or when the byte is not
+//*				contiguous with it
+//***************************************************************************
+void page_add(unsigned int address, unsigned char value)
+{
+  unsigned char offset;
+  offset = address & (ICP_PAGE_SIZE - 1);		// offset of the byte in its page
+  if((page_end != page_start) &&				// flush on a non-contiguous address
+     ((page_high != (unsigned char)(address >> 8)) ||
+      (page_low != (unsigned char)(address & ~(ICP_PAGE_SIZE - 1))) ||
+      (page_end != offset)))
+  {
+    page_flush();
+  }
+  if(page_end == page_start)					// start a new page
+  {
+    page_high = address >> 8;
+    page_low = address & ~(ICP_PAGE_SIZE - 1);
+    page_start = offset;
+    page_end = offset;
+  }
+  page_bytes[page_end++] = value;				// put byte in the page buffer
+  if(page_end == ICP_PAGE_SIZE)					// flush on a page boundary
+  {
+    page_flush();
+  }
+}
+
+//***************************************************************************
+//* page_flush()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : function to program the page assembly buffer with a
+//*				single LOAD/PROG cycle, only the bytes loaded into the page
+//*				register are written so a partial page goes the same way.
+//*				On a page erased in this session erased bytes at either
+//*				end are not loaded, a page of only erased bytes is skipped
+//***************************************************************************
+void page_flush(void)
+{
+  unsigned char start;
+  unsigned char end;
+  unsigned int page;
+  if(page_end == page_start)					// nothing to program
+  {
+    return;
+  }
+  start = page_start;
+  end = page_end;
+  address_high = page_high;
+  address_low = page_low;
+  page = (((unsigned int)page_high << 8) | page_low) / ICP_PAGE_SIZE;
+  if(page_erased(page))
+  {
+    for(; (start < end) && (page_bytes[start] == ICP_ERASED); start++);
+    for(; (end > start) && (page_bytes[end - 1] == ICP_ERASED); end--);
+  }
+  if(end == start)								// target holds this already
+  {
+    page_start = 0;
+    page_end = 0;
+    page_acks = 0;
+    return;
+  }
+  if(end - start == 1)							// a single byte
+  {
+    address_low += start;
+    program_byte = page_bytes[start];
+    program();
+  }
+  else
+  {
+    program_page(page_bytes, start, end);
+  }
+  erased_mark(page, 1, 0);						// no longer known blank
+  page_start = 0;								// page buffer is empty again
+  page_end = 0;
+  page_acks = 0;								// their oks go once programmed
+}
+
+//***************************************************************************
+//* erased_mark()
+//* Input(s) : page, count, erased.
+//* Returns : none.
+//* Description : function to set or clear the erased bit of count pages
+//***************************************************************************
+void erased_mark(unsigned int page, unsigned int count, unsigned char erased)
+{
+  while(count--)
+  {
+    if(erased)
+    {
+      erased_pages[page >> 3] |= 1 << (page & 7);
+    }
+    else
+    {
+      erased_pages[page >> 3] &= ~(1 << (page & 7));
+    }
+    page = (page + 1) & (ICP_PAGES - 1);
+  }
+}
+
+//***************************************************************************
+//* page_erased()
+//* Input(s) : page.
+//* Returns : 1 when the page was erased in this session and not programmed.
+//* Description :
+//***************************************************************************
+unsigned char page_erased(unsigned int page)
+{
+  return (erased_pages[page >> 3] >> (page & 7)) & 1;
+}
+
@@ -38,6 +38,29 @@ void UART1_BaudRateCfg( UINT32 baudrate )
     R16_UART1_DL = (UINT16)x;
 }
 
+/*******************************************************************************
+* Function Name  : UART1_BaudRateCfgErr
+* Description    : ڲãʵʲ
+* Input          : baudrate: 
+                   maxerr: λ0.1%
+* Return         : ʵλ0.1%maxerrʱ޸ĵǰ
+*******************************************************************************/
+INT16 UART1_BaudRateCfgErr( UINT32 baudrate, UINT16 maxerr )
+{
+    UINT32	x, real;
+    INT32	err;
+
+    if( baudrate == 0 )     return 0x7FFF;
+    x = 10 * GetSysClock() / 8 / baudrate;
+    x = ( x + 5 ) / 10;
+    if( x == 0 || x > 0xFFFF )      return 0x7FFF;                          // ƵϵΧ
+    real = GetSysClock() / 8 / x;
+    err = ( (INT32)real - (INT32)baudrate ) * 1000 / (INT32)baudrate;
+    if( err > (INT32)maxerr || err < -(INT32)maxerr )   return (INT16)err;
+    R16_UART1_DL = (UINT16)x;
+    return (INT16)err;
+}
+
 /*******************************************************************************
 * Function Name  : UART1_ByteTrigCfg
 * Description    : ֽڴж
@@ -62,6 +62,7 @@ UINT16 UART0_RecvString( PUINT8 buf );					/* 
 /****************** UART1 */ 	 
 void UART1_DefInit( void );	 							/* Ĭϳʼ */
 void UART1_BaudRateCfg( UINT32 baudrate );	 			/* ڲ */
+INT16 UART1_BaudRateCfgErr( UINT32 baudrate, UINT16 maxerr );	/* ڲã */
 void UART1_ByteTrigCfg( UARTByteTRIGTypeDef b );        /* ֽڴж */
 void UART1_INTCfg( UINT8 s,  UINT8 i );		            /* ж */
 void UART1_Reset( void );								/* λ */
@@ -0,0 +1,816 @@
+//***************************************************************************
+//* 								hal_host.c
+//*	Discription : host backend of Application/inc/hal.h. The bridge runs
+//*				as a Linux process against the LPC900 model in
+//*				lpc900_sim.c, on a virtual clock counted in Fsys cycles.
+//*
+//*				The bit kernels are charged HAL_STORE_CYCLES and friends
+//*				per port access, SPI0 bytes their PCL periods at the
+//*				divider in use, delays move the clock on and HAL_IDLE()
+//*				moves it to the next event, or by HAL_IDLE_US when there
+//*				is none. Events are the TMR2 poll tick, the arrival of the
+//*				next ISP character, which is paced at 10 bit times of the
+//*				divisor in use, and the end of the last character sent,
+//*				paced the same way. The interrupt handlers are called from
+//*				here at the time of their event but never inside each
+//*				other. On the CH579 UART1 preempts the TMR2 poll, here a
+//*				character that arrives during a poll waits for its end.
+//*
+//*				UART1 is stdin/stdout, or a pseudo terminal when
+//*				ISP2ICP_LINK is "pty", its name is printed on stderr.
+//*				On a pipe the host is taken to answer at once: when the
+//*				bridge waits for it with nothing else to do, the process
+//*				blocks on stdin and the clock stands still, so the times
+//*				are those of a host with no turnaround. On a pty real time
+//*				is let pass while the bridge is idle.
+//*				At the end of stdin the bridge finishes what it was doing,
+//*				waits HAL_EOF_MS and exits. A summary goes to stderr and
+//*				the target Flash to the file named by ISP2ICP_DUMP, the
+//*				counters, with the ICP counters of the bridge per
+//*				operation, to the one named by ISP2ICP_STATS.
+//*				ISP2ICP_FLASH sets the Flash size of the target and
+//*				ISP2ICP_PDA_DELAY its output delay in nsec.
+//*
+//***************************************************************************
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/select.h>
+#include "hal.h"
+#include "progdef.h"
+#include "lpc900_sim.h"
+#include "icp_stats.h"
+#include "icp_spi.h"
+
+//***************************************************************************
+//* Host settings
+//***************************************************************************
+#define HAL_CYCLES_US	(FREQ_SYS / 1000000)	// Fsys cycles per usec
+#define HAL_IDLE_US		10			// clock step of an idle call without an event
+#define HAL_IDLE_SPIN	100			// idle calls before the process sleeps on the link
+#define HAL_SLEEP_US	1000		// longest sleep on the link
+#define HAL_EOF_MS		1000		// quiet time after the end of stdin before exiting
+#define HAL_WIRE_SIZE	4096		// characters read ahead from the link
+#define HAL_OUT_SIZE	4096		// characters collected before writing to the link
+
+//***************************************************************************
+//* interrupt handlers of the application
+//***************************************************************************
+void UART1_IRQHandler(void);
+void TMR2_IRQHandler(void);
+
+//***************************************************************************
+//* target and clock
+//***************************************************************************
+lpc900_sim hal_target;							// the LPC9xx on the ICP pins
+unsigned long long hal_now = 0;					// Fsys cycles since start
+unsigned char hal_in_irq = 0;					// an interrupt handler is running
+unsigned char hal_port = 0;						// output latch of PA[7:0]
+unsigned char hal_pda_out = 1;					// PDA driven by the bridge
+unsigned char hal_applied = 0;					// VCC and RESET as last given to the model
+//***************************************************************************
+//* TMR2
+//***************************************************************************
+unsigned char hal_poll_on = 0;					// timer running
+unsigned long long hal_poll_due;				// time of the next tick
+unsigned long hal_poll_period;					// cycles between ticks
+//***************************************************************************
+//* SPI0
+//***************************************************************************
+unsigned char hal_spi_divider = ICP_SPI_CLKDIV;	// Fsys cycles per PCL period
+//***************************************************************************
+//* UART1, characters wait on the wire until their arrival time, then in
+//* the FIFO until the receive interrupt takes them
+//***************************************************************************
+unsigned short hal_uart_divisor = 0;			// UART1 divisor, Fsys / 8 / baud
+int hal_in_fd = 0;								// link to read from
+int hal_out_fd = 1;								// link to write to
+unsigned char hal_eof = 0;						// no more characters will come
+unsigned char hal_wire[HAL_WIRE_SIZE];			// read from the link, not yet arrived
+unsigned int hal_wire_head = 0;
+unsigned int hal_wire_count = 0;
+unsigned long long hal_wire_due;				// arrival time of the first one
+unsigned long long hal_read_next = 0;			// earliest time to try the link again
+unsigned char hal_fifo[UART_FIFO_SIZE];			// receive FIFO
+unsigned char hal_fifo_head = 0;
+unsigned char hal_fifo_count = 0;
+unsigned char hal_line_status = 0;				// RB_LSR_ bits not read yet
+unsigned char hal_tx_irq = 0;					// THR empty interrupt enabled
+unsigned char hal_out[HAL_OUT_SIZE];			// characters to be written
+unsigned int hal_out_count = 0;
+//***************************************************************************
+//* statistics
+//***************************************************************************
+unsigned long hal_link_in = 0;					// characters received by the bridge
+unsigned long hal_link_out = 0;					// characters sent by the bridge
+unsigned long hal_overruns = 0;					// characters lost in a full FIFO
+unsigned long hal_poll_ticks = 0;				// TMR2 poll interrupts
+unsigned long long hal_first_in = 0;			// arrival of the first character
+unsigned long long hal_last_out = 0;			// time the last character sent is out
+unsigned int hal_idle_runs = 0;					// idle calls without an event
+unsigned long long hal_quiet = 0;				// cycles idle since the end of stdin
+
+//***************************************************************************
+//* hal_ns()
+//* Input(s) : none.
+//* Returns : virtual time in nsec for the target model.
+//* Description :
+//***************************************************************************
+static unsigned long long hal_ns(void)
+{
+  return hal_now * 1000 / HAL_CYCLES_US;
+}
+
+//***************************************************************************
+//* hal_char_cycles()
+//* Input(s) : none.
+//* Returns : Fsys cycles of one character, start, 8 data and stop bit.
+//* Description :
+//***************************************************************************
+static unsigned long hal_char_cycles(void)
+{
+  return 10UL * 8 * hal_uart_divisor;
+}
+
+//***************************************************************************
+//* hal_link_flush()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : write the collected characters to the link
+//***************************************************************************
+static void hal_link_flush(void)
+{
+  unsigned int done = 0;
+  int written;
+  while(done < hal_out_count)
+  {
+    written = write(hal_out_fd, hal_out + done, hal_out_count - done);
+    if(written < 0)
+    {
+      if(errno == EINTR || errno == EAGAIN) continue;
+      break;									// nobody listens, drop it
+    }
+    done += written;
+  }
+  hal_out_count = 0;
+}
+
+//***************************************************************************
+//* hal_link_read()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : fetch characters from the link once the wire is empty,
+//*				the first arrives a character time from now. On a pipe
+//*				not before the last character sent is out
+//***************************************************************************
+static void hal_link_read(void)
+{
+  int length;
+  if(hal_eof || hal_wire_count || (hal_now < hal_read_next))
+  {
+    return;
+  }
+  if((hal_in_fd == 0) && (hal_now < hal_last_out))	// the host answers what it has received
+  {
+    return;
+  }
+  length = read(hal_in_fd, hal_wire, HAL_WIRE_SIZE);
+  if(length > 0)
+  {
+    hal_wire_head = 0;
+    hal_wire_count = length;
+    hal_wire_due = hal_now + hal_char_cycles();
+    return;
+  }
+  if((length == 0) && (hal_in_fd == 0))			// end of stdin, a pty has no end
+  {
+    hal_eof = 1;
+  }
+  hal_read_next = hal_now + hal_char_cycles();	// try again a character later
+}
+
+//***************************************************************************
+//* hal_uart_isr()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : run the UART1 handler while it has something to do
+//***************************************************************************
+static void hal_uart_isr(void)
+{
+  if(hal_in_irq || (hal_uart_flag() == UART_II_NO_INTER))
+  {
+    return;
+  }
+  hal_in_irq = 1;
+  while(hal_uart_flag() != UART_II_NO_INTER)
+  {
+    UART1_IRQHandler();
+  }
+  hal_in_irq = 0;
+}
+
+//***************************************************************************
+//* hal_advance()
+//* Input(s) : target, time to move the clock to.
+//* Returns : none.
+//* Description : move the clock on, handing out the events on the way
+//***************************************************************************
+static void hal_advance(unsigned long long target)
+{
+  unsigned long long tick;
+  while(1)
+  {
+    hal_link_read();
+    if(hal_wire_count && (hal_wire_due <= target) &&
+       (hal_in_irq || !hal_poll_on || (hal_wire_due <= hal_poll_due)))
+    {
+      if(hal_wire_due > hal_now) hal_now = hal_wire_due;
+      if(hal_fifo_count == UART_FIFO_SIZE)		// the handler was held up too long
+      {
+        hal_line_status |= RB_LSR_OVER_ERR;
+        hal_overruns++;
+      }
+      else
+      {
+        hal_fifo[(hal_fifo_head + hal_fifo_count++) % UART_FIFO_SIZE] = hal_wire[hal_wire_head];
+        if(!hal_link_in++) hal_first_in = hal_now;
+      }
+      hal_wire_head++;
+      hal_wire_count--;
+      hal_wire_due += hal_char_cycles();
+      hal_quiet = 0;
+      hal_uart_isr();
+      continue;
+    }
+    if(!hal_in_irq && hal_poll_on && (hal_poll_due <= target))
+    {
+      tick = hal_poll_due;
+      if(tick > hal_now) hal_now = tick;
+      hal_in_irq = 1;
+      hal_poll_ticks++;
+      TMR2_IRQHandler();
+      hal_in_irq = 0;
+      if(hal_poll_on)
+      {
+        hal_poll_due = tick + hal_poll_period;
+        if(hal_poll_due < hal_now) hal_poll_due = hal_now;	// pending again at once
+      }
+      hal_uart_isr();							// characters that came in meanwhile
+      continue;
+    }
+    break;
+  }
+  if(target > hal_now) hal_now = target;
+  hal_uart_isr();
+}
+
+//***************************************************************************
+//* hal_op_table()
+//* Input(s) : out, file, prefix, put in front of every line.
+//* Returns : none.
+//* Description : the ICP counters of the bridge, a line per operation
+//*				that was used
+//***************************************************************************
+static void hal_op_table(FILE *out, const char *prefix)
+{
+  static const char *names[ICP_OPS] = {"other", "program", "page", "erase_g", "erase_s", "erase_p",
+                                       "crc_g", "crc_s", "config", "read", "blank"};
+  unsigned char op;
+  for(op = 0; op < ICP_OPS; op++)
+  {
+    if(icp_stats[op].calls || icp_stats[op].edges)
+    {
+      fprintf(out, "%s%-8s %8lu %10lu %8lu %8lu %8lu\n", prefix, names[op], icp_stats[op].calls,
+              icp_stats[op].edges, icp_stats[op].turnarounds, icp_stats[op].opcodes, icp_stats[op].polls);
+    }
+  }
+}
+
+//***************************************************************************
+//* hal_stats()
+//* Input(s) : name, file to write.
+//* Returns : none.
+//* Description : counters as "key value" lines, times in Fsys cycles
+//***************************************************************************
+static void hal_stats(const char *name)
+{
+  FILE *stats = fopen(name, "w");
+  if(!stats)
+  {
+    return;
+  }
+  fprintf(stats, "fsys %lu\n", (unsigned long)FREQ_SYS);
+  fprintf(stats, "now %llu\n", hal_now);
+  fprintf(stats, "first_in %llu\n", hal_first_in);
+  fprintf(stats, "last_out %llu\n", hal_last_out);
+  fprintf(stats, "link_in %lu\n", hal_link_in);
+  fprintf(stats, "link_out %lu\n", hal_link_out);
+  fprintf(stats, "overruns %lu\n", hal_overruns);
+  fprintf(stats, "uart_divisor %u\n", hal_uart_divisor);
+  fprintf(stats, "poll_ticks %lu\n", hal_poll_ticks);
+  fprintf(stats, "edges %lu\n", hal_target.edges);
+  fprintf(stats, "bytes_in %lu\n", hal_target.bytes_in);
+  fprintf(stats, "bytes_out %lu\n", hal_target.bytes_out);
+  fprintf(stats, "fast_edges %lu\n", hal_target.fast_edges);
+  fprintf(stats, "busy_violations %lu\n", hal_target.busy_violations);
+  fprintf(stats, "bus_time_ns %llu\n", hal_target.bus_time);
+  fprintf(stats, "bus_halves %lu\n", hal_target.bus_halves);
+  hal_op_table(stats, "op ");
+  fclose(stats);
+}
+
+//***************************************************************************
+//* hal_exit()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : summary on stderr, Flash dump and counters, end of the
+//*				process
+//***************************************************************************
+static void hal_exit(void)
+{
+  FILE *dump;
+  char *name;
+  hal_link_flush();
+  fprintf(stderr, "isp2icp: %.3f msec, link %lu in %lu out %lu overruns\n",
+          (double)hal_now / HAL_CYCLES_US / 1000, hal_link_in, hal_link_out, hal_overruns);
+  fprintf(stderr, "isp2icp: icp %lu edges %lu bytes in %lu bytes out %lu fast edges %lu busy violations\n",
+          hal_target.edges, hal_target.bytes_in, hal_target.bytes_out,
+          hal_target.fast_edges, hal_target.busy_violations);
+  fprintf(stderr, "isp2icp: %-8s %8s %10s %8s %8s %8s\n", "op", "calls", "edges", "turns", "opcodes", "polls");
+  hal_op_table(stderr, "isp2icp: ");
+  name = getenv("ISP2ICP_DUMP");
+  if(name && (dump = fopen(name, "wb")) != NULL)
+  {
+    fwrite(hal_target.flash, 1, hal_target.flash_size, dump);
+    fclose(dump);
+  }
+  name = getenv("ISP2ICP_STATS");
+  if(name)
+  {
+    hal_stats(name);
+  }
+  exit(0);
+}
+
+//***************************************************************************
+//* hal_sleep()
+//* Input(s) : none.
+//* Returns : Fsys cycles the process slept.
+//* Description : wait on the link for up to HAL_SLEEP_US of real time
+//***************************************************************************
+static unsigned long hal_sleep(void)
+{
+  fd_set readable;
+  struct timeval timeout;
+  struct timespec start;
+  struct timespec end;
+  long slept;
+  FD_ZERO(&readable);
+  FD_SET(hal_in_fd, &readable);
+  timeout.tv_sec = 0;
+  timeout.tv_usec = HAL_SLEEP_US;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  select(hal_in_fd + 1, &readable, NULL, NULL, &timeout);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  slept = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000;
+  hal_read_next = 0;							// look at the link right away
+  return (slept < HAL_IDLE_US ? HAL_IDLE_US : slept) * HAL_CYCLES_US;
+}
+
+//***************************************************************************
+//* hal_block()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : wait on the link until the host writes or closes it,
+//*				the clock stands still meanwhile
+//***************************************************************************
+static void hal_block(void)
+{
+  fd_set readable;
+  hal_link_flush();
+  FD_ZERO(&readable);
+  FD_SET(hal_in_fd, &readable);
+  select(hal_in_fd + 1, &readable, NULL, NULL, NULL);
+  hal_read_next = 0;
+  hal_link_read();
+}
+
+//***************************************************************************
+//* hal_waiting()
+//* Input(s) : none.
+//* Returns : 1 when the bridge can only be waiting for the host.
+//* Description : on a pipe the host is taken to answer at once, so with
+//*				no event left it is blocked on rather than timed out
+//***************************************************************************
+static unsigned char hal_waiting(void)
+{
+  return (hal_in_fd == 0) && !hal_eof && !hal_poll_on && !hal_wire_count && !hal_fifo_count &&
+         !hal_tx_irq && (hal_last_out <= hal_now);
+}
+
+//***************************************************************************
+//* hal_wait_us()
+//* Input(s) : t, usec.
+//* Returns : none.
+//* Description : a delay while waiting for the host
+//***************************************************************************
+void hal_wait_us(unsigned long t)
+{
+  if(hal_waiting())
+  {
+    hal_block();
+  }
+  hal_delay_us(t);
+}
+
+//***************************************************************************
+//* hal_idle()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : the application waits for an interrupt. Move to the next
+//*				event, when there is none let real time pass on the link
+//***************************************************************************
+void hal_idle(void)
+{
+  unsigned long long step = HAL_IDLE_US * HAL_CYCLES_US;
+  hal_link_flush();
+  if(hal_poll_on || hal_wire_count || hal_fifo_count || (hal_last_out > hal_now))
+  {
+    hal_idle_runs = 0;
+    if((hal_last_out > hal_now) && (hal_last_out < hal_now + step)) step = hal_last_out - hal_now;
+    if(hal_poll_on && (hal_poll_due < hal_now + step)) step = (hal_poll_due > hal_now) ? hal_poll_due - hal_now : 0;
+    if(hal_wire_count && (hal_wire_due < hal_now + step)) step = (hal_wire_due > hal_now) ? hal_wire_due - hal_now : 0;
+  }
+  else if(hal_eof)
+  {
+    hal_quiet += step;
+    if(hal_quiet >= HAL_EOF_MS * 1000UL * HAL_CYCLES_US)
+    {
+      hal_exit();
+    }
+  }
+  else if(hal_waiting())
+  {
+    hal_block();
+  }
+  else if(++hal_idle_runs > HAL_IDLE_SPIN)		// the host is thinking, don't burn the CPU
+  {
+    step = hal_sleep();
+  }
+  hal_advance(hal_now + step);
+}
+
+//***************************************************************************
+//* hal_cycles()
+//* Input(s) : cycles.
+//* Returns : none.
+//* Description : charge the time an instruction sequence takes
+//***************************************************************************
+void hal_cycles(unsigned long cycles)
+{
+  hal_advance(hal_now + cycles);
+}
+
+//***************************************************************************
+//* hal_delay_us()
+//* Input(s) : t, usec.
+//* Returns : none.
+//* Description :
+//***************************************************************************
+void hal_delay_us(unsigned long t)
+{
+  hal_advance(hal_now + (unsigned long long)t * HAL_CYCLES_US);
+}
+
+//***************************************************************************
+//* hal_bus()
+//* Input(s) : none.
+//* Returns : PDA level on the bus.
+//* Description : hand the pin levels to the model, PDA is pulled up when
+//*				neither side drives it
+//***************************************************************************
+static unsigned char hal_bus(void)
+{
+  unsigned char changed = (hal_port ^ hal_applied) & (ICP_VCC | ICP_RESET);
+  if(changed & ICP_VCC)
+  {
+    lpc900_power(&hal_target, hal_ns(), (hal_port & ICP_VCC) != 0);
+  }
+  if(changed & ICP_RESET)
+  {
+    lpc900_reset(&hal_target, hal_ns(), (hal_port & ICP_RESET) != 0);
+  }
+  hal_applied = hal_port;
+  return lpc900_bus(&hal_target, hal_ns(), (hal_port & ICP_PCL) != 0,
+                    hal_pda_out ? ((hal_port & ICP_PDA) != 0) : 1);
+}
+
+//***************************************************************************
+//* GPIO
+//***************************************************************************
+void hal_pin_set(unsigned long pins)
+{
+  hal_port |= (unsigned char)pins;
+  hal_bus();
+}
+
+void hal_pin_clear(unsigned long pins)
+{
+  hal_port &= (unsigned char)~pins;
+  hal_bus();
+}
+
+unsigned char hal_port_levels(void)
+{
+  hal_cycles(HAL_LOAD_CYCLES);
+  return hal_port;
+}
+
+void hal_port_write(unsigned char value)
+{
+  hal_cycles(HAL_STORE_CYCLES);
+  hal_port = value;
+  hal_bus();
+}
+
+unsigned char hal_port_read(void)
+{
+  hal_cycles(HAL_LOAD_CYCLES);
+  return (hal_port & (unsigned char)~ICP_PDA) | (hal_bus() << ICP_PDA_BIT);
+}
+
+void hal_pda_drive(unsigned char on)
+{
+  hal_pda_out = on;
+  hal_bus();
+}
+
+//***************************************************************************
+//* hal_spi_byte()
+//* Input(s) : value, bits for MOSI.
+//* Returns : bits read on MISO.
+//* Description : SCK is PCL and MOSI and MISO are both PDA of the model.
+//*				Mode 3 with the low bit first: MOSI changes on the falling
+//*				edge, and MISO is sampled half a period after the rising
+//*				edge, as with the master input delay hal_spi_clock() sets
+//***************************************************************************
+static unsigned char hal_spi_byte(unsigned char value)
+{
+  unsigned char data = 0;
+  unsigned char bit;
+  unsigned long low = hal_spi_divider / 2;		// Fsys cycles with SCK low
+  unsigned long high = hal_spi_divider - low;
+  hal_cycles(HAL_STORE_CYCLES);					// the buffer write starts the transfer
+  for(bit = 0; bit < 8; bit++)
+  {
+    hal_port = (hal_port & (unsigned char)~(ICP_PCL | ICP_PDA)) | (((value >> bit) & 0x01) << ICP_PDA_BIT);
+    hal_bus();
+    hal_cycles(low);
+    hal_port |= ICP_PCL;
+    hal_bus();
+    hal_cycles(high);
+    data |= hal_bus() << bit;
+  }
+  hal_cycles(HAL_LOAD_CYCLES);					// end flag and buffer read
+  return data;
+}
+
+//***************************************************************************
+//* SPI0
+//***************************************************************************
+void hal_spi_init(void)
+{
+  hal_spi_clock(ICP_SPI_CLKDIV);
+  hal_port |= ICP_PCL | ICP_PDA;				// SCK idles high
+  hal_pda_out = 1;
+  hal_bus();
+}
+
+void hal_spi_clock(unsigned char divider)
+{
+  hal_spi_divider = (divider < 2) ? 2 : divider;
+}
+
+void hal_spi_send(unsigned char value)
+{
+  hal_spi_byte(value);
+}
+
+unsigned char hal_spi_recv(void)
+{
+  return hal_spi_byte(0xFF);
+}
+
+void hal_spi_burst(unsigned char *data, unsigned short length)
+{
+  while(length--)
+  {
+    hal_spi_byte(*data++);
+  }
+}
+
+//***************************************************************************
+//* TMR2
+//***************************************************************************
+void hal_poll_start(unsigned long cycles)
+{
+  hal_poll_period = cycles;
+  hal_poll_due = hal_now + cycles;
+  hal_poll_on = 1;
+}
+
+void hal_poll_reload(unsigned long cycles)
+{
+  hal_poll_period = cycles;
+}
+
+void hal_poll_stop(void)
+{
+  hal_poll_on = 0;
+}
+
+//***************************************************************************
+//* UART1
+//***************************************************************************
+unsigned char hal_uart_flag(void)
+{
+  if(hal_line_status) return UART_II_LINE_STAT;
+  if(hal_fifo_count) return UART_II_RECV_RDY;
+  if(hal_tx_irq) return UART_II_THR_EMPTY;
+  return UART_II_NO_INTER;
+}
+
+unsigned char hal_uart_line(void)
+{
+  unsigned char status = hal_line_status;
+  hal_line_status = 0;
+  return status;
+}
+
+unsigned char hal_uart_rx_level(void)
+{
+  return hal_fifo_count;
+}
+
+unsigned char hal_uart_rx_byte(void)
+{
+  unsigned char value = hal_fifo[hal_fifo_head];
+  if(hal_fifo_count)
+  {
+    hal_fifo_head = (hal_fifo_head + 1) % UART_FIFO_SIZE;
+    hal_fifo_count--;
+  }
+  return value;
+}
+
+void hal_uart_tx_byte(unsigned char value)
+{
+  if(hal_out_count == HAL_OUT_SIZE)
+  {
+    hal_link_flush();
+  }
+  hal_out[hal_out_count++] = value;
+  hal_link_out++;
+  if(hal_last_out < hal_now) hal_last_out = hal_now;
+  hal_last_out += hal_char_cycles();
+}
+
+unsigned char hal_uart_tx_empty(void)
+{
+  return hal_now >= hal_last_out;
+}
+
+void hal_uart_tx_irq(unsigned char on)
+{
+  hal_tx_irq = on;
+}
+
+//***************************************************************************
+//* hal_uart_baud()
+//* Input(s) : baudrate, maxerr, largest error in 0.1%.
+//* Returns : rate error in 0.1%, the divisor is only set within maxerr.
+//* Description : as UART1_BaudRateCfgErr()
+//***************************************************************************
+short hal_uart_baud(unsigned long baudrate, unsigned short maxerr)
+{
+  unsigned long divisor;
+  long error;
+  if(baudrate == 0) return 0x7FFF;
+  divisor = (10UL * FREQ_SYS / 8 / baudrate + 5) / 10;
+  if((divisor == 0) || (divisor > 0xFFFF)) return 0x7FFF;
+  error = ((long)(FREQ_SYS / 8 / divisor) - (long)baudrate) * 1000 / (long)baudrate;
+  if((error > (long)maxerr) || (error < -(long)maxerr)) return (short)error;
+  hal_uart_divisor = (unsigned short)divisor;
+  return (short)error;
+}
+
+//***************************************************************************
+//* hal_link_open()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : stdin/stdout, or a raw pseudo terminal. On a pipe the
+//*				first record is taken to be there from the start, so the
+//*				clock only starts once the host has written
+//***************************************************************************
+static void hal_link_open(void)
+{
+  char *link = getenv("ISP2ICP_LINK");
+  struct termios mode;
+  fd_set readable;
+  int fd;
+  if(link && !strcmp(link, "pty"))
+  {
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if((fd < 0) || grantpt(fd) || unlockpt(fd))
+    {
+      perror("isp2icp: pty");
+      exit(1);
+    }
+    if(!tcgetattr(fd, &mode))
+    {
+      cfmakeraw(&mode);
+      tcsetattr(fd, TCSANOW, &mode);
+    }
+    fprintf(stderr, "isp2icp: %s\n", ptsname(fd));
+    hal_in_fd = hal_out_fd = fd;
+  }
+  fcntl(hal_in_fd, F_SETFL, fcntl(hal_in_fd, F_GETFL) | O_NONBLOCK);
+  if(hal_in_fd == 0)
+  {
+    FD_ZERO(&readable);
+    FD_SET(hal_in_fd, &readable);
+    select(hal_in_fd + 1, &readable, NULL, NULL, NULL);
+  }
+}
+
+//***************************************************************************
+//* hal_pins_init()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : the target starts unpowered with blank Flash, the pins
+//*				low as after GPIOA_ModeCfg()
+//***************************************************************************
+void hal_pins_init(void)
+{
+  char *size = getenv("ISP2ICP_FLASH");
+  char *delay = getenv("ISP2ICP_PDA_DELAY");
+  unsigned long flash_size = size ? strtoul(size, NULL, 0) : SIM_FLASH_MAX;
+  if((flash_size == 0) || (flash_size > SIM_FLASH_MAX) || (flash_size & (flash_size - 1)))
+  {
+    flash_size = SIM_FLASH_MAX;
+  }
+  lpc900_init(&hal_target, (unsigned int)flash_size);
+  if(delay)
+  {
+    hal_target.pda_delay = strtoul(delay, NULL, 0);
+  }
+  hal_port = 0;
+  hal_pda_out = 1;
+  hal_link_open();
+}
+
+//***************************************************************************
+//* hal_uart_init()
+//* Input(s) : baudrate.
+//* Returns : none.
+//* Description :
+//***************************************************************************
+void hal_uart_init(unsigned long baudrate)
+{
+  hal_uart_baud(baudrate, 0x7FFF);
+  hal_fifo_count = 0;
+  hal_line_status = 0;
+  hal_tx_irq = 0;
+}
+
+//***************************************************************************
+//* hal_poll_init()
+//* Input(s) : none.
+//* Returns : none.
+//* Description :
+//***************************************************************************
+void hal_poll_init(void)
+{
+  hal_poll_on = 0;
+}
+
+//***************************************************************************
+//* hal_time_init(), hal_time_us()
+//* Input(s) : none.
+//* Returns : usec of the virtual clock.
+//* Description : the virtual clock is the time base
+//***************************************************************************
+void hal_time_init(void)
+{
+}
+
+unsigned long hal_time_us(void)
+{
+  return (unsigned long)(hal_now / HAL_CYCLES_US);
+}
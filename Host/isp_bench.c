@@ -0,0 +1,598 @@
+//***************************************************************************
+//* 								isp_bench.c
+//*	Discription : programming throughput benchmark for the host build of
+//*				the bridge. Every image is programmed by a fresh bridge
+//*				process as Flash Magic would: echo off, LOAD_BAUD, chip
+//*				erase and one PROGRAM record per hex record, each sent
+//*				after the reply to the one before. Records longer than
+//*				ICP_PAGE_SIZE are split. The target Flash is compared
+//*				with the image afterwards.
+//*
+//*				Times come from the virtual clock of the bridge, from the
+//*				first character it receives to the last reply it sends,
+//*				so the figures are the modelled wall clock of the session
+//*				and do not depend on the speed of the host. A session
+//*				without records is run first, its time (start up, ICP
+//*				entry, calibration and chip erase) is taken off the
+//*				others to give the time spent on the records.
+//*
+//*				isp_bench [-b baud] [-d pda_delay] [-o results.json]
+//*				          bridge [image.hex ...]
+//*
+//*				Without images the built in corpus is used: dense (16K
+//*				in 16 byte records), sparse (islands in the 16K) and
+//*				unaligned (13 byte records from an odd address).
+//*
+//***************************************************************************
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+//***************************************************************************
+//* Settings, as in Application/inc/progdef.h
+//***************************************************************************
+#define BENCH_FLASH		0x4000		// Flash of the simulated target
+#define BENCH_PAGE_SIZE	64			// longest PROGRAM record the bridge takes
+#define BENCH_RECORDS	4096		// records in an image
+#define BENCH_LINE		600			// longest line of a hex file or a reply
+#define BENCH_BAUD		115200		// default ISP rate
+
+#define PROGRAM			0
+#define MISC_WRITE		2
+#define LOAD_BAUD		7
+#define CHIP_ERASE		9
+#define ICP_CLOCK		10
+#define MISC_ECHO		0x20
+#define BENCH_OPS		16			// ICP operations the bridge reports
+
+//***************************************************************************
+//* an image, its records in file order and the bytes they set
+//***************************************************************************
+typedef struct
+{
+  unsigned int address;
+  unsigned char length;
+} bench_record;
+
+typedef struct
+{
+  char name[64];
+  bench_record records[BENCH_RECORDS];
+  unsigned int count;							// records
+  unsigned long bytes;							// data bytes
+  unsigned char flash[BENCH_FLASH];
+  unsigned char used[BENCH_FLASH];				// 1 where a record sets the byte
+} bench_image;
+
+//***************************************************************************
+//* result of one run
+//***************************************************************************
+typedef struct
+{
+  unsigned long stats_fsys;
+  unsigned long long first_in;
+  unsigned long long last_out;
+  unsigned long link_in;
+  unsigned long link_out;
+  unsigned long overruns;
+  unsigned long poll_ticks;
+  unsigned long edges;
+  unsigned long bytes_in;
+  unsigned long bytes_out;
+  unsigned long fast_edges;
+  unsigned long busy_violations;
+  unsigned long long bus_time_ns;
+  unsigned long bus_halves;
+  unsigned int icp_clock;						// setting in use after calibration
+  unsigned int icp_clock_limit;					// fastest stable setting
+  unsigned int ops;								// lines in op
+  struct
+  {
+    char name[16];
+    unsigned long calls;
+    unsigned long edges;
+    unsigned long turnarounds;
+    unsigned long opcodes;
+    unsigned long polls;
+  } op[BENCH_OPS];								// ICP counters of the bridge per operation
+  unsigned long errors;							// replies other than '.'
+  unsigned long mismatches;						// Flash bytes unlike the image
+} bench_result;
+
+bench_image image;
+FILE *to_bridge;
+FILE *from_bridge;
+pid_t bridge_pid;
+
+//***************************************************************************
+//* image_add()
+//* Input(s) : address, data, length.
+//* Returns : 0 when the record does not fit.
+//* Description : add a record to the image, split into PROGRAM sizes
+//***************************************************************************
+static int image_add(unsigned int address, const unsigned char *data, unsigned int length)
+{
+  unsigned int piece;
+  unsigned int index;
+  while(length)
+  {
+    piece = (length > BENCH_PAGE_SIZE) ? BENCH_PAGE_SIZE : length;
+    if((image.count == BENCH_RECORDS) || (address + piece > BENCH_FLASH))
+    {
+      return 0;
+    }
+    image.records[image.count].address = address;
+    image.records[image.count].length = piece;
+    image.count++;
+    for(index = 0; index < piece; index++)
+    {
+      image.flash[address + index] = data[index];
+      image.used[address + index] = 1;
+    }
+    image.bytes += piece;
+    address += piece;
+    data += piece;
+    length -= piece;
+  }
+  return 1;
+}
+
+//***************************************************************************
+//* image_clear()
+//* Input(s) : name.
+//* Returns : none.
+//* Description :
+//***************************************************************************
+static void image_clear(const char *name)
+{
+  memset(&image, 0, sizeof(image));
+  memset(image.flash, 0xFF, sizeof(image.flash));
+  strncpy(image.name, name, sizeof(image.name) - 1);
+}
+
+//***************************************************************************
+//* image_load()
+//* Input(s) : path, Intel hex file.
+//* Returns : 0 on a read or format error.
+//* Description : data records are kept, extended address records must
+//*				stay in the first 64K
+//***************************************************************************
+static int image_load(const char *path)
+{
+  FILE *file;
+  char line[BENCH_LINE];
+  unsigned char bytes[BENCH_LINE / 2];
+  unsigned int count;
+  unsigned int index;
+  unsigned int value;
+  unsigned char sum;
+  const char *base;
+  base = strrchr(path, '/');
+  image_clear(base ? base + 1 : path);
+  file = fopen(path, "r");
+  if(!file)
+  {
+    perror(path);
+    return 0;
+  }
+  while(fgets(line, sizeof(line), file))
+  {
+    if(line[0] != ':') continue;
+    for(count = 0; sscanf(line + 1 + 2 * count, "%2x", &value) == 1; count++)
+    {
+      bytes[count] = value;
+    }
+    sum = 0;
+    for(index = 0; index < count; index++) sum += bytes[index];
+    if((count < 5) || (count != bytes[0] + 5u) || sum)
+    {
+      fprintf(stderr, "%s: bad record %s", path, line);
+      fclose(file);
+      return 0;
+    }
+    if(bytes[3] == 0x01) break;					// end of file
+    if(((bytes[3] == 0x02) || (bytes[3] == 0x04)) && !bytes[4] && !bytes[5]) continue;
+    if(bytes[3] != 0x00)
+    {
+      fprintf(stderr, "%s: record type %02X not supported\n", path, bytes[3]);
+      fclose(file);
+      return 0;
+    }
+    if(!image_add((bytes[1] << 8) | bytes[2], bytes + 4, bytes[0]))
+    {
+      fprintf(stderr, "%s: image too large for the target\n", path);
+      fclose(file);
+      return 0;
+    }
+  }
+  fclose(file);
+  return 1;
+}
+
+//***************************************************************************
+//* image_corpus()
+//* Input(s) : which, 0 dense, 1 sparse, 2 unaligned.
+//* Returns : none.
+//* Description : built in images, the data is a fixed pseudo random
+//*				sequence with some 0xFF runs as in real code
+//***************************************************************************
+static void image_corpus(int which)
+{
+  static const char *names[3] = {"dense", "sparse", "unaligned"};
+  unsigned char data[BENCH_FLASH];
+  unsigned long seed = 12345;
+  unsigned int index;
+  unsigned int address;
+  for(index = 0; index < BENCH_FLASH; index++)
+  {
+    seed = seed * 1103515245UL + 12345;
+    data[index] = ((index & 0x3FF) > 0x3C0) ? 0xFF : (unsigned char)(seed >> 16);
+  }
+  image_clear(names[which]);
+  switch(which)
+  {
+    case 0:
+      for(address = 0; address < BENCH_FLASH; address += 16)
+      {
+        image_add(address, data + address, 16);
+      }
+      break;
+    case 1:
+      for(address = 0x0000; address < BENCH_FLASH; address += 0x0A00)
+      {
+        image_add(address, data + address, 0x60);
+        image_add(address + 0x100, data + address + 0x100, 0x18);
+      }
+      break;
+    default:
+      for(address = 0x0005; address + 13 <= 0x2000; address += 13)
+      {
+        image_add(address, data + address, 13);
+      }
+      break;
+  }
+}
+
+//***************************************************************************
+//* bridge_start()
+//* Input(s) : bridge, path of the host build, delay, PDA delay, stats,
+//*			dump, files for the counters and the Flash.
+//* Returns : 0 when the process could not be started.
+//* Description :
+//***************************************************************************
+static int bridge_start(const char *bridge, const char *delay, const char *stats, const char *dump)
+{
+  int to_child[2];
+  int from_child[2];
+  if(pipe(to_child) || pipe(from_child))
+  {
+    perror("pipe");
+    return 0;
+  }
+  bridge_pid = fork();
+  if(bridge_pid < 0)
+  {
+    perror("fork");
+    return 0;
+  }
+  if(bridge_pid == 0)
+  {
+    dup2(to_child[0], 0);
+    dup2(from_child[1], 1);
+    close(to_child[0]);
+    close(to_child[1]);
+    close(from_child[0]);
+    close(from_child[1]);
+    setenv("ISP2ICP_STATS", stats, 1);
+    setenv("ISP2ICP_DUMP", dump, 1);
+    setenv("ISP2ICP_PDA_DELAY", delay, 1);
+    unsetenv("ISP2ICP_LINK");
+    execl(bridge, bridge, (char *)NULL);
+    perror(bridge);
+    _exit(127);
+  }
+  close(to_child[0]);
+  close(from_child[1]);
+  to_bridge = fdopen(to_child[1], "w");
+  from_bridge = fdopen(from_child[0], "r");
+  return 1;
+}
+
+//***************************************************************************
+//* bridge_record()
+//* Input(s) : type, address, data, length, reply, where the reply line
+//*			goes, crlf, 0 to leave off the CR LF after the record.
+//* Returns : status character of the reply, 0 when the bridge is gone.
+//* Description : send a record and wait for the reply
+//***************************************************************************
+static int bridge_record(unsigned char type, unsigned int address, const unsigned char *data,
+                         unsigned int length, char *reply, int crlf)
+{
+  unsigned char sum;
+  unsigned int index;
+  size_t end;
+  sum = length + (address >> 8) + address + type;
+  fprintf(to_bridge, ":%02X%04X%02X", length, address & 0xFFFF, type);
+  for(index = 0; index < length; index++)
+  {
+    fprintf(to_bridge, "%02X", data[index]);
+    sum += data[index];
+  }
+  fprintf(to_bridge, "%02X%s", (unsigned char)-sum, crlf ? "\r\n" : "");
+  fflush(to_bridge);
+  do
+  {
+    if(!fgets(reply, BENCH_LINE, from_bridge))
+    {
+      return 0;
+    }
+    end = strlen(reply);
+    while(end && ((reply[end - 1] == '\r') || (reply[end - 1] == '\n'))) reply[--end] = 0;
+  } while(!end);								// CR LF echoed before echo was off
+  return reply[end - 1];
+}
+
+//***************************************************************************
+//* bridge_finish()
+//* Input(s) : stats, dump, files written by the bridge, result.
+//* Returns : 0 when the bridge did not end normally.
+//* Description : end of input, wait for the bridge and read its files
+//***************************************************************************
+static int bridge_finish(const char *stats, const char *dump, bench_result *result)
+{
+  FILE *file;
+  char line[BENCH_LINE];
+  char key[32];
+  unsigned long long value;
+  unsigned char flash[BENCH_FLASH];
+  unsigned int index;
+  int status;
+  fclose(to_bridge);
+  while(fgetc(from_bridge) != EOF);
+  fclose(from_bridge);
+  if((waitpid(bridge_pid, &status, 0) < 0) || !WIFEXITED(status) || WEXITSTATUS(status))
+  {
+    return 0;
+  }
+  file = fopen(stats, "r");
+  if(!file)
+  {
+    return 0;
+  }
+  while(fgets(line, sizeof(line), file))
+  {
+    if(!strncmp(line, "op ", 3) && (result->ops < BENCH_OPS) &&
+       (sscanf(line + 3, "%15s %lu %lu %lu %lu %lu", result->op[result->ops].name,
+               &result->op[result->ops].calls, &result->op[result->ops].edges,
+               &result->op[result->ops].turnarounds, &result->op[result->ops].opcodes,
+               &result->op[result->ops].polls) == 6))
+    {
+      result->ops++;
+      continue;
+    }
+    if(sscanf(line, "%31s %llu", key, &value) != 2) continue;
+    if(!strcmp(key, "fsys")) result->stats_fsys = value;
+    else if(!strcmp(key, "first_in")) result->first_in = value;
+    else if(!strcmp(key, "last_out")) result->last_out = value;
+    else if(!strcmp(key, "link_in")) result->link_in = value;
+    else if(!strcmp(key, "link_out")) result->link_out = value;
+    else if(!strcmp(key, "overruns")) result->overruns = value;
+    else if(!strcmp(key, "poll_ticks")) result->poll_ticks = value;
+    else if(!strcmp(key, "edges")) result->edges = value;
+    else if(!strcmp(key, "bytes_in")) result->bytes_in = value;
+    else if(!strcmp(key, "bytes_out")) result->bytes_out = value;
+    else if(!strcmp(key, "fast_edges")) result->fast_edges = value;
+    else if(!strcmp(key, "busy_violations")) result->busy_violations = value;
+    else if(!strcmp(key, "bus_time_ns")) result->bus_time_ns = value;
+    else if(!strcmp(key, "bus_halves")) result->bus_halves = value;
+  }
+  fclose(file);
+  file = fopen(dump, "rb");
+  if(!file || (fread(flash, 1, BENCH_FLASH, file) != BENCH_FLASH))
+  {
+    if(file) fclose(file);
+    return 0;
+  }
+  fclose(file);
+  for(index = 0; index < BENCH_FLASH; index++)
+  {
+    if(flash[index] != image.flash[index]) result->mismatches++;
+  }
+  return result->stats_fsys != 0;
+}
+
+//***************************************************************************
+//* bench_run()
+//* Input(s) : bridge, baud, delay, result.
+//* Returns : 0 when the session broke down.
+//* Description : program the image with a fresh bridge
+//***************************************************************************
+static int bench_run(const char *bridge, unsigned long baud, const char *delay, bench_result *result)
+{
+  char stats[] = "/tmp/isp_bench_stats_XXXXXX";
+  char dump[] = "/tmp/isp_bench_dump_XXXXXX";
+  char reply[BENCH_LINE];
+  unsigned char data[4];
+  unsigned int index;
+  int ok;
+  int fd;
+  memset(result, 0, sizeof(*result));
+  if((fd = mkstemp(stats)) < 0) return 0;
+  close(fd);
+  if((fd = mkstemp(dump)) < 0) return 0;
+  close(fd);
+  ok = bridge_start(bridge, delay, stats, dump);
+  data[0] = MISC_ECHO;							// echo off, no CR LF left to echo
+  data[1] = 0;
+  ok = ok && (bridge_record(MISC_WRITE, 0, data, 2, reply, 0) == '.');
+  data[0] = baud >> 24;
+  data[1] = baud >> 16;
+  data[2] = baud >> 8;
+  data[3] = baud;
+  ok = ok && (bridge_record(LOAD_BAUD, 0, data, 4, reply, 1) == '.');
+  ok = ok && (bridge_record(ICP_CLOCK, 0, NULL, 0, reply, 1) == '.');
+  if(ok)
+  {
+    sscanf(reply, "%2x%2x", &result->icp_clock, &result->icp_clock_limit);
+  }
+  ok = ok && (bridge_record(CHIP_ERASE, 0, NULL, 0, reply, 1) == '.');
+  for(index = 0; ok && (index < image.count); index++)
+  {
+    switch(bridge_record(PROGRAM, image.records[index].address, image.flash + image.records[index].address,
+                         image.records[index].length, reply, 1))
+    {
+      case '.':
+        break;
+      case 0:
+        ok = 0;
+        break;
+      default:
+        result->errors++;
+        break;
+    }
+  }
+  ok = bridge_finish(stats, dump, result) && ok;
+  unlink(stats);
+  unlink(dump);
+  return ok;
+}
+
+//***************************************************************************
+//* bench_report()
+//* Input(s) : out, results file, result, ok, first, 1 for the first run,
+//*			setup, seconds of the session without records.
+//* Returns : none.
+//* Description : one JSON object per run and a line on stdout
+//***************************************************************************
+static void bench_report(FILE *out, const bench_result *result, int ok, int first, double setup)
+{
+  double session = 0;
+  double seconds = 0;
+  double pcl = 0;
+  unsigned int index;
+  if(result->stats_fsys && (result->last_out > result->first_in))
+  {
+    session = (double)(result->last_out - result->first_in) / result->stats_fsys;
+  }
+  if(session > setup)
+  {
+    seconds = session - setup;
+  }
+  ok = ok && !result->errors && !result->mismatches;
+  if(result->bus_time_ns)
+  {
+    pcl = result->bus_halves / 2.0 / result->bus_time_ns * 1e6;	// kHz
+  }
+  fprintf(out, "%s    {\"image\": \"%s\", \"ok\": %s, \"records\": %u, \"bytes\": %lu, "
+          "\"session_seconds\": %.6f, \"seconds\": %.6f, \"records_per_s\": %.1f, \"bytes_per_s\": %.1f, "
+          "\"edges\": %lu, \"edges_per_byte\": %.2f, \"fmcon_polls\": %lu, "
+          "\"icp_bytes_in\": %lu, \"icp_bytes_out\": %lu, \"pcl_khz\": %.1f, "
+          "\"icp_clock\": %u, \"icp_clock_limit\": %u, \"fast_edges\": %lu, "
+          "\"busy_violations\": %lu, \"link_in\": %lu, \"link_out\": %lu, "
+          "\"overruns\": %lu, \"errors\": %lu, \"mismatches\": %lu, \"ops\": {",
+          first ? "" : ",\n", image.name, ok ? "true" : "false", image.count, image.bytes,
+          session, seconds, seconds ? image.count / seconds : 0, seconds ? image.bytes / seconds : 0,
+          result->edges, image.bytes ? (double)result->edges / image.bytes : 0, result->poll_ticks,
+          result->bytes_in, result->bytes_out, pcl,
+          result->icp_clock, result->icp_clock_limit, result->fast_edges,
+          result->busy_violations, result->link_in, result->link_out,
+          result->overruns, result->errors, result->mismatches);
+  for(index = 0; index < result->ops; index++)
+  {
+    fprintf(out, "%s\"%s\": {\"calls\": %lu, \"edges\": %lu, \"turnarounds\": %lu, \"opcodes\": %lu, \"polls\": %lu}",
+            index ? ", " : "", result->op[index].name, result->op[index].calls, result->op[index].edges,
+            result->op[index].turnarounds, result->op[index].opcodes, result->op[index].polls);
+  }
+  fprintf(out, "}}");
+  printf("%-16s %s %5u rec %6lu B %9.3f s %8.1f rec/s %8.1f B/s %6.1f edges/B %5lu polls %7.1f kHz PCL\n",
+         image.name, ok ? "ok  " : "FAIL",
+         image.count, image.bytes, seconds, seconds ? image.count / seconds : 0,
+         seconds ? image.bytes / seconds : 0, image.bytes ? (double)result->edges / image.bytes : 0,
+         result->poll_ticks, pcl);
+}
+
+//***************************************************************************
+//* main()
+//* Input(s) : argc, argv.
+//* Returns : 0 when every image was programmed and verified.
+//* Description :
+//***************************************************************************
+int main(int argc, char **argv)
+{
+  unsigned long baud = BENCH_BAUD;
+  const char *delay = "0";
+  const char *output = "isp_bench.json";
+  const char *bridge;
+  bench_result result;
+  FILE *out;
+  int option;
+  int runs;
+  int index;
+  int ok;
+  int reported = 0;
+  int failed = 0;
+  double setup = 0;
+  signal(SIGPIPE, SIG_IGN);
+  while((option = getopt(argc, argv, "b:d:o:")) != -1)
+  {
+    switch(option)
+    {
+      case 'b': baud = strtoul(optarg, NULL, 0); break;
+      case 'd': delay = optarg; break;
+      case 'o': output = optarg; break;
+      default:
+        fprintf(stderr, "usage: %s [-b baud] [-d pda_delay_ns] [-o results.json] bridge [image.hex ...]\n", argv[0]);
+        return 2;
+    }
+  }
+  if(optind >= argc)
+  {
+    fprintf(stderr, "usage: %s [-b baud] [-d pda_delay_ns] [-o results.json] bridge [image.hex ...]\n", argv[0]);
+    return 2;
+  }
+  bridge = argv[optind++];
+  out = fopen(output, "w");
+  if(!out)
+  {
+    perror(output);
+    return 2;
+  }
+  image_clear("setup");
+  if(!bench_run(bridge, baud, delay, &result) || !result.stats_fsys)
+  {
+    fprintf(stderr, "%s: session without records failed\n", bridge);
+    fclose(out);
+    return 1;
+  }
+  setup = (double)(result.last_out - result.first_in) / result.stats_fsys;
+  fprintf(out, "{\"baud\": %lu, \"pda_delay_ns\": %s, \"setup_seconds\": %.6f, \"runs\": [\n",
+          baud, delay, setup);
+  runs = (optind < argc) ? argc - optind : 3;
+  for(index = 0; index < runs; index++)
+  {
+    if(optind < argc)
+    {
+      if(!image_load(argv[optind + index]))
+      {
+        failed = 1;
+        continue;
+      }
+    }
+    else
+    {
+      image_corpus(index);
+    }
+    ok = bench_run(bridge, baud, delay, &result);
+    bench_report(out, &result, ok, !reported++, setup);
+    failed |= !ok || result.errors || result.mismatches;
+  }
+  fprintf(out, "\n]}\n");
+  fclose(out);
+  return failed;
+}
@@ -0,0 +1,504 @@
+//***************************************************************************
+//* 								isp_test.c
+//*	Discription : record level tests for the host build of the bridge.
+//*				Each test sends records to a fresh bridge process and
+//*				compares the replies, and at the end the target Flash,
+//*				with what the firmware has to answer.
+//*
+//*				isp_test bridge
+//*
+//*				Prints a line per test and exits with 1 when any failed.
+//*
+//***************************************************************************
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+//***************************************************************************
+//* Settings, as in Application/inc/progdef.h
+//***************************************************************************
+#define TEST_FLASH		0x4000		// Flash of the simulated target
+#define TEST_LINE		2048		// longest record or reply
+#define TEST_ERASED		0xFF
+#define TEST_PDA_DELAY	"40"		// nsec the target takes to drive a result bit
+#define TEST_EMPTY		80			// program records without data, more than the ok slots
+
+#define PROGRAM			0
+#define READ_VERSION	1
+#define MISC_WRITE		2
+#define READ_FLASH		12
+#define BLANK_CHECK		13
+#define MISC_ECHO		0x20
+#define MISC_WINDOW		0x22
+
+//***************************************************************************
+//* bridge under test
+//***************************************************************************
+const char *bridge;
+FILE *to_bridge;
+FILE *from_bridge;
+pid_t bridge_pid;
+char dump[] = "/tmp/isp_test_dump_XXXXXX";
+unsigned char flash[TEST_FLASH];				// target Flash after the last session
+unsigned int failures = 0;
+unsigned char test_window = 0;				// status lines end in sequence and credits
+
+//***************************************************************************
+//* bridge_start()
+//* Input(s) : none.
+//* Returns : 0 when the process could not be started.
+//* Description : start the bridge with echo off
+//***************************************************************************
+static int bridge_start(void)
+{
+  int to_child[2];
+  int from_child[2];
+  char reply[TEST_LINE];
+  if(pipe(to_child) || pipe(from_child))
+  {
+    perror("pipe");
+    return 0;
+  }
+  bridge_pid = fork();
+  if(bridge_pid < 0)
+  {
+    perror("fork");
+    return 0;
+  }
+  if(bridge_pid == 0)
+  {
+    dup2(to_child[0], 0);
+    dup2(from_child[1], 1);
+    close(to_child[0]);
+    close(to_child[1]);
+    close(from_child[0]);
+    close(from_child[1]);
+    setenv("ISP2ICP_DUMP", dump, 1);
+    setenv("ISP2ICP_PDA_DELAY", TEST_PDA_DELAY, 1);
+    unsetenv("ISP2ICP_STATS");
+    unsetenv("ISP2ICP_LINK");
+    execl(bridge, bridge, (char *)NULL);
+    perror(bridge);
+    _exit(127);
+  }
+  close(to_child[0]);
+  close(from_child[1]);
+  to_bridge = fdopen(to_child[1], "w");
+  from_bridge = fdopen(from_child[0], "r");
+  test_window = 0;
+  fputs(":0200000220" "00DC", to_bridge);		// echo off, no CR LF left to echo
+  fflush(to_bridge);
+  return fgets(reply, sizeof(reply), from_bridge) && strstr(reply, ".");
+}
+
+//***************************************************************************
+//* bridge_finish()
+//* Input(s) : none.
+//* Returns : 0 when the bridge did not end normally.
+//* Description : end of input, wait for the bridge and read the Flash
+//***************************************************************************
+static int bridge_finish(void)
+{
+  FILE *file;
+  int status;
+  fclose(to_bridge);
+  while(fgetc(from_bridge) != EOF);
+  fclose(from_bridge);
+  if((waitpid(bridge_pid, &status, 0) < 0) || !WIFEXITED(status) || WEXITSTATUS(status))
+  {
+    return 0;
+  }
+  file = fopen(dump, "rb");
+  if(!file || (fread(flash, 1, TEST_FLASH, file) != TEST_FLASH))
+  {
+    if(file) fclose(file);
+    return 0;
+  }
+  fclose(file);
+  return 1;
+}
+
+//***************************************************************************
+//* record_text()
+//* Input(s) : text, type, address, data, length, error, added to the
+//*			checksum.
+//* Returns : text.
+//* Description : a hex record with CR LF
+//***************************************************************************
+static char *record_text(char *text, unsigned char type, unsigned int address,
+                         const unsigned char *data, unsigned int length, unsigned char error)
+{
+  unsigned char sum;
+  unsigned int index;
+  char *end = text;
+  sum = length + (address >> 8) + address + type;
+  end += sprintf(end, ":%02X%04X%02X", length & 0xFF, address & 0xFFFF, type);
+  for(index = 0; index < length; index++)
+  {
+    end += sprintf(end, "%02X", data[index]);
+    sum += data[index];
+  }
+  sprintf(end, "%02X\r\n", (unsigned char)(-sum + error));
+  return text;
+}
+
+//***************************************************************************
+//* reply_text()
+//* Input(s) : text, address, data, length, read back data, status, the
+//*			rest of the status line.
+//* Returns : text.
+//* Description : the reply to a READ_FLASH of up to 32 bytes
+//***************************************************************************
+static char *reply_text(char *text, unsigned int address, const unsigned char *data, unsigned int length,
+                        const char *status)
+{
+  record_text(text, PROGRAM, address, data, length, 0);
+  sprintf(text + strlen(text) - 2, " %s", status);	// data record, then the status line
+  return text;
+}
+
+//***************************************************************************
+//* test_send()
+//* Input(s) : text, characters to send, reply, where the reply goes.
+//* Returns : 0 when the bridge is gone.
+//* Description : send and read the reply up to its status line, the
+//*				lines are put together with a space between them
+//***************************************************************************
+static int test_send(const char *text, char *reply)
+{
+  char line[TEST_LINE];
+  size_t end;
+  size_t length = 0;
+  fputs(text, to_bridge);
+  fflush(to_bridge);
+  reply[0] = 0;
+  while(fgets(line, sizeof(line), from_bridge))
+  {
+    end = strlen(line);
+    while(end && ((line[end - 1] == '\r') || (line[end - 1] == '\n'))) line[--end] = 0;
+    if(!end)
+    {
+      continue;
+    }
+    if(length && (length + 1 < TEST_LINE))
+    {
+      reply[length++] = ' ';
+    }
+    strncpy(reply + length, line, TEST_LINE - length - 1);
+    reply[TEST_LINE - 1] = 0;
+    length = strlen(reply);
+    if(line[0] != ':')							// status line ends the reply
+    {
+      if(test_window && (length >= 2))
+      {
+        reply[length - 2] = 0;					// credits depend on the timing
+      }
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//***************************************************************************
+//* test_check()
+//* Input(s) : name, text, characters to send, expected, reply wanted.
+//* Returns : none.
+//* Description :
+//***************************************************************************
+static void test_check(const char *name, const char *text, const char *expected)
+{
+  char reply[TEST_LINE];
+  if(!test_send(text, reply))
+  {
+    strcpy(reply, "(no reply)");
+  }
+  if(strcmp(reply, expected))
+  {
+    printf("FAIL %-28s got \"%s\", want \"%s\"\n", name, reply, expected);
+    failures++;
+    return;
+  }
+  printf("ok   %s\n", name);
+}
+
+//***************************************************************************
+//* test_flash()
+//* Input(s) : name, address, data, length.
+//* Returns : none.
+//* Description : compare the Flash of the last session
+//***************************************************************************
+static void test_flash(const char *name, unsigned int address, const unsigned char *data, unsigned int length)
+{
+  if(memcmp(flash + address, data, length))
+  {
+    printf("FAIL %-28s Flash at %04X differs\n", name, address);
+    failures++;
+    return;
+  }
+  printf("ok   %s\n", name);
+}
+
+//***************************************************************************
+//* test_decoder()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : receive_record() takes well formed records in either
+//*				case and answers X to a bad checksum, a non hex character
+//*				or more than ICP_PAGE_SIZE data bytes, then goes on with
+//*				the next record
+//***************************************************************************
+static void test_decoder(void)
+{
+  char text[TEST_LINE];
+  unsigned char data[255];
+  unsigned char erased[16];
+  unsigned int index;
+  for(index = 0; index < sizeof(data); index++)
+  {
+    data[index] = index * 7 + 3;
+  }
+  memset(erased, TEST_ERASED, sizeof(erased));
+  if(!bridge_start())
+  {
+    printf("FAIL decoder: bridge did not start\n");
+    failures++;
+    return;
+  }
+  test_check("decoder: read version", record_text(text, READ_VERSION, 0, NULL, 0, 0), "0606.");
+  test_check("decoder: lower case", ":00000001ff\r\n", "0606.");
+  test_check("decoder: program 16 bytes", record_text(text, PROGRAM, 0x0000, data, 16, 0), ".");
+  test_check("decoder: checksum error", record_text(text, PROGRAM, 0x0100, data, 16, 1), "X");
+  record_text(text, PROGRAM, 0x0200, data, 16, 0);
+  text[20] = 'G';
+  test_check("decoder: bad data character", text, "X");
+  record_text(text, PROGRAM, 0x0300, data, 16, 0);
+  text[2] = ' ';
+  test_check("decoder: bad length character", text, "X");
+  test_check("decoder: 65 data bytes", record_text(text, PROGRAM, 0x0400, data, 65, 0), "X");
+  test_check("decoder: 255 data bytes", record_text(text, PROGRAM, 0x0500, data, 255, 0), "X");
+  test_check("decoder: record after rejects", record_text(text, PROGRAM, 0x0010, data + 16, 16, 0), ".");
+  test_check("decoder: 64 data bytes", record_text(text, PROGRAM, 0x0600, data, 64, 0), ".");
+  if(!bridge_finish())
+  {
+    printf("FAIL decoder: bridge did not end normally\n");
+    failures++;
+    return;
+  }
+  test_flash("decoder: accepted records", 0x0000, data, 32);
+  test_flash("decoder: checksum error", 0x0100, erased, 16);
+  test_flash("decoder: bad data character", 0x0200, erased, 16);
+  test_flash("decoder: bad length character", 0x0300, erased, 16);
+  test_flash("decoder: 65 data bytes", 0x0400, erased, 16);
+  test_flash("decoder: 255 data bytes", 0x0500, erased, 16);
+  test_flash("decoder: 64 data bytes", 0x0600, data, 64);
+}
+
+//***************************************************************************
+//* test_read_flash()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : in window mode a READ_FLASH can arrive while program
+//*				records are still in the page buffer. The page is
+//*				programmed first and the read must then work on its own
+//*				address, not on the one the page was programmed at
+//***************************************************************************
+static void test_read_flash(void)
+{
+  char text[TEST_LINE];
+  char expected[TEST_LINE];
+  unsigned char data[16];
+  unsigned char erased[4];
+  unsigned char length[2];
+  unsigned int index;
+  for(index = 0; index < sizeof(data); index++)
+  {
+    data[index] = 0xA0 + index;
+  }
+  memset(erased, TEST_ERASED, sizeof(erased));
+  if(!bridge_start())
+  {
+    printf("FAIL read flash: bridge did not start\n");
+    failures++;
+    return;
+  }
+  test_window = 1;
+  length[0] = MISC_WINDOW;
+  length[1] = 1;
+  test_check("read flash: window on", record_text(text, MISC_WRITE, 0x0000, length, 2, 0), ".01");
+  length[0] = 0;									// both records in flight
+  length[1] = sizeof(erased);
+  record_text(text, PROGRAM, 0x0000, data, 16, 0);
+  record_text(text + strlen(text), READ_FLASH, 0x0100, length, 2, 0);
+  test_check("read flash: partial page", text, ".00");
+  test_check("read flash: other address", "", reply_text(expected, 0x0100, erased, sizeof(erased), ".01"));
+  length[1] = sizeof(data);
+  record_text(text, PROGRAM, 0x0208, data, 16, 0);
+  record_text(text + strlen(text), READ_FLASH, 0x0208, length, 2, 0);
+  test_check("read flash: unaligned page", text, ".02");
+  test_check("read flash: same page", "", reply_text(expected, 0x0208, data, sizeof(data), ".03"));
+  if(!bridge_finish())
+  {
+    printf("FAIL read flash: bridge did not end normally\n");
+    failures++;
+    return;
+  }
+  test_flash("read flash: partial page", 0x0000, data, 16);
+  test_flash("read flash: unaligned page", 0x0208, data, 16);
+}
+
+//***************************************************************************
+//* test_blank_check()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : as test_read_flash() for BLANK_CHECK, which also marks
+//*				the pages it found blank as erased. A program record into
+//*				such a page afterwards has to land all the same
+//***************************************************************************
+static void test_blank_check(void)
+{
+  char text[TEST_LINE];
+  char expected[TEST_LINE];
+  unsigned char data[16];
+  unsigned char length[2];
+  unsigned int index;
+  for(index = 0; index < sizeof(data); index++)
+  {
+    data[index] = (index & 1) ? TEST_ERASED : 0x50 + index;
+  }
+  if(!bridge_start())
+  {
+    printf("FAIL blank check: bridge did not start\n");
+    failures++;
+    return;
+  }
+  test_window = 1;
+  length[0] = MISC_WINDOW;
+  length[1] = 1;
+  test_check("blank check: window on", record_text(text, MISC_WRITE, 0x0000, length, 2, 0), ".01");
+  length[0] = 0x01;								// both records in flight
+  length[1] = 0x00;
+  record_text(text, PROGRAM, 0x0000, data, 16, 0);
+  record_text(text + strlen(text), BLANK_CHECK, 0x0100, length, 2, 0);
+  test_check("blank check: partial page", text, ".00");
+  test_check("blank check: other address", "", ".01");
+  length[0] = 0x00;
+  length[1] = 0x30;
+  record_text(text, PROGRAM, 0x0208, data, 16, 0);
+  record_text(text + strlen(text), BLANK_CHECK, 0x0210, length, 2, 0);
+  test_check("blank check: unaligned page", text, ".02");
+  test_check("blank check: same page", "", "0210.03");
+  length[1] = sizeof(data);
+  record_text(text, PROGRAM, 0x0140, data, 16, 0);
+  record_text(text + strlen(text), READ_FLASH, 0x0140, length, 2, 0);
+  test_check("blank check: page found blank", text, ".04");
+  test_check("blank check: read back", "", reply_text(expected, 0x0140, data, sizeof(data), ".05"));
+  if(!bridge_finish())
+  {
+    printf("FAIL blank check: bridge did not end normally\n");
+    failures++;
+    return;
+  }
+  test_flash("blank check: partial page", 0x0000, data, 16);
+  test_flash("blank check: unaligned page", 0x0208, data, 16);
+  test_flash("blank check: page found blank", 0x0140, data, 16);
+}
+
+//***************************************************************************
+//* test_empty_records()
+//* Input(s) : none.
+//* Returns : none.
+//* Description : program records without data behind a partial page add
+//*				oks but no bytes. More of them than the bridge has ok
+//*				slots must all be answered, in order
+//***************************************************************************
+static void test_empty_records(void)
+{
+  char text[TEST_LINE];
+  char expected[TEST_LINE];
+  char reply[TEST_LINE];
+  unsigned char data[16];
+  unsigned char length[2];
+  unsigned int index;
+  for(index = 0; index < sizeof(data); index++)
+  {
+    data[index] = 0x30 + index;
+  }
+  if(!bridge_start())
+  {
+    printf("FAIL empty records: bridge did not start\n");
+    failures++;
+    return;
+  }
+  test_window = 1;
+  length[0] = MISC_WINDOW;
+  length[1] = 1;
+  test_check("empty records: window on", record_text(text, MISC_WRITE, 0x0000, length, 2, 0), ".01");
+  record_text(text, PROGRAM, 0x0000, data, 16, 0);	// all records in flight
+  for(index = 0; index < TEST_EMPTY; index++)
+  {
+    record_text(text + strlen(text), PROGRAM, 0x0010, NULL, 0, 0);
+  }
+  length[0] = 0;
+  length[1] = sizeof(data);
+  record_text(text + strlen(text), READ_FLASH, 0x0000, length, 2, 0);
+  for(index = 0; index <= TEST_EMPTY; index++)
+  {
+    sprintf(expected, ".%02X", index);
+    if(!test_send(index ? "" : text, reply) || strcmp(reply, expected))
+    {
+      break;
+    }
+  }
+  if(index <= TEST_EMPTY)
+  {
+    printf("FAIL %-28s got \"%s\", want \"%s\"\n", "empty records: oks", reply, expected);
+    failures++;
+  }
+  else
+  {
+    printf("ok   %s\n", "empty records: oks");
+  }
+  sprintf(expected, ".%02X", TEST_EMPTY + 1);
+  test_check("empty records: read back", "", reply_text(text, 0x0000, data, sizeof(data), expected));
+  if(!bridge_finish())
+  {
+    printf("FAIL empty records: bridge did not end normally\n");
+    failures++;
+    return;
+  }
+  test_flash("empty records: partial page", 0x0000, data, 16);
+}
+
+//***************************************************************************
+//* main()
+//* Input(s) : argc, argv.
+//* Returns : 0 when every test passed.
+//* Description :
+//***************************************************************************
+int main(int argc, char **argv)
+{
+  int fd;
+  if(argc != 2)
+  {
+    fprintf(stderr, "usage: isp_test bridge\n");
+    return 2;
+  }
+  bridge = argv[1];
+  if((fd = mkstemp(dump)) < 0)
+  {
+    perror("mkstemp");
+    return 2;
+  }
+  close(fd);
+  test_decoder();
+  test_read_flash();
+  test_blank_check();
+  test_empty_records();
+  unlink(dump);
+  printf("%s, %u failed\n", failures ? "FAILED" : "passed", failures);
+  return failures != 0;
+}
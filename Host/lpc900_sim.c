@@ -0,0 +1,447 @@
+//***************************************************************************
+//* 								lpc900_sim.c
+//*	Discription : behavioural model of the ICP slave of an LPC9xx.
+//*
+//*				The bus is fed one pin change at a time with a time stamp.
+//*				The part samples PDA on every rising PCL edge, LSB first.
+//*				An even opcode takes the next byte as its operand, an odd
+//*				opcode makes the part drive its 8 result bits on the
+//*				following rising edges while the master has PDA released.
+//*
+//*				Flash commands written to FMCON keep the part busy for
+//*				the SIM_TIME_ durations, FMCON reads back SIM_FMCON_BUSY
+//*				meanwhile. Commands given while busy are refused and
+//*				counted, as the bridge must never do that.
+//*
+//*				FMDATA writes after LOAD go into the page register at the
+//*				low address bits, the _I/_PG forms step the address within
+//*				the page. PROG writes the loaded bytes to the page FMADR
+//*				points at. After CRC_G/CRC_S the result is read LSB first
+//*				with RD_FMDATA_I, until 4 bytes are read or FMADR is
+//*				written. CONF selects the config space for FMDATA, CCP
+//*				followed by the CLR_CCP_KEY data clears config protection.
+//*
+//*				pda_delay models the output delay of the part and its
+//*				wiring: a master that samples sooner after the rising
+//*				edge reads the previous bit, as a too fast PCL would.
+//*
+//***************************************************************************
+#include <string.h>
+#include "lpc900_sim.h"
+
+//***************************************************************************
+//* ICP opcodes and FMCON commands, as in Application/inc/progdef.h
+//***************************************************************************
+#define SIM_NOP			0x00
+#define SIM_WR_FMADRL	0x08
+#define SIM_RD_FMADRL	0x09
+#define SIM_WR_FMADRH	0x0A
+#define SIM_RD_FMADRH	0x0B
+#define SIM_WR_FMCON	0x0E
+#define SIM_RD_FMCON	0x0F
+#define SIM_WR_FMDATA_PG 0x14
+#define SIM_RD_FMDATA_PG 0x15
+#define SIM_WR_FMDATA	0x0C
+#define SIM_RD_FMDATA	0x0D
+#define SIM_WR_FMDATA_I	0x04
+#define SIM_RD_FMDATA_I	0x05
+#define SIM_CLR_CCP_KEY	0x96
+
+#define SIM_LOAD		0x00
+#define SIM_PROG		0x48
+#define SIM_ERS_G		0x72
+#define SIM_ERS_S		0x71
+#define SIM_ERS_P		0x70
+#define SIM_CONF		0x6C
+#define SIM_CRC_G		0x1A
+#define SIM_CRC_S		0x19
+#define SIM_CCP			0x67
+
+//***************************************************************************
+//* lpc900_crc()
+//* Input(s) : data, length.
+//* Returns : CRC as calculated by CRC_G and CRC_S.
+//* Description : 32 bit CRC with polynomial x^32+x^22+x^2+x+1, each byte
+//*				is xored into the low bits after the shift
+//***************************************************************************
+unsigned long lpc900_crc(const unsigned char *data, unsigned int length)
+{
+  unsigned long crc = 0;
+  unsigned int index;
+  for(index = 0; index < length; index++)
+  {
+    crc = ((crc << 1) ^ ((crc & 0x80000000UL) ? 0x00400007UL : 0) ^ data[index]) & 0xFFFFFFFFUL;
+  }
+  return crc;
+}
+
+//***************************************************************************
+//* lpc900_init()
+//* Input(s) : sim, flash_size, a power of 2 up to SIM_FLASH_MAX.
+//* Returns : none.
+//* Description : an unpowered part with blank Flash
+//***************************************************************************
+void lpc900_init(lpc900_sim *sim, unsigned int flash_size)
+{
+  memset(sim, 0, sizeof(*sim));
+  sim->flash_size = flash_size;
+  memset(sim->flash, 0xFF, sizeof(sim->flash));
+  sim->config[0] = 0x63;						// UCFG1 as shipped
+  sim->fmcon = 0xFF;							// no command selected
+  sim->pcl = 1;
+  sim->pda_out = 1;
+}
+
+//***************************************************************************
+//* lpc900_busy()
+//* Input(s) : sim, now.
+//* Returns : 1 while a Flash command is running.
+//* Description :
+//***************************************************************************
+unsigned char lpc900_busy(lpc900_sim *sim, unsigned long long now)
+{
+  return now < sim->busy_until;
+}
+
+//***************************************************************************
+//* lpc900_power()
+//* Input(s) : sim, now, on.
+//* Returns : none.
+//* Description : VCC pin of the target
+//***************************************************************************
+void lpc900_power(lpc900_sim *sim, unsigned long long now, unsigned char on)
+{
+  sim->now = now;
+  sim->powered = on;
+  sim->pulses = 0;
+  sim->icp = 0;
+  sim->driving = 0;
+  sim->busy_until = 0;
+}
+
+//***************************************************************************
+//* lpc900_reset()
+//* Input(s) : sim, now, level.
+//* Returns : none.
+//* Description : RESET pin, SIM_ENTRY_PULSES pulses after power up enter
+//*				ICP mode, the bus starts with a fresh byte
+//***************************************************************************
+void lpc900_reset(lpc900_sim *sim, unsigned long long now, unsigned char level)
+{
+  sim->now = now;
+  if(sim->powered && !sim->reset && level)		// rising edge of RESET
+  {
+    if(sim->pulses < SIM_ENTRY_PULSES)
+    {
+      sim->pulses++;
+    }
+    if(sim->pulses == SIM_ENTRY_PULSES)
+    {
+      sim->icp = 1;
+      sim->bits = 0;
+      sim->shift = 0;
+      sim->have_opcode = 0;
+      sim->driving = 0;
+    }
+  }
+  sim->reset = level;
+}
+
+//***************************************************************************
+//* sim_start()
+//* Input(s) : sim, duration.
+//* Returns : 0 when the part is still busy with the previous command.
+//* Description : start a Flash command
+//***************************************************************************
+static unsigned char sim_start(lpc900_sim *sim, unsigned long duration)
+{
+  if(lpc900_busy(sim, sim->now))
+  {
+    sim->busy_violations++;
+    sim->status |= SIM_FMCON_OI;
+    return 0;
+  }
+  sim->status &= (unsigned char)~SIM_FMCON_OI;
+  sim->busy_until = sim->now + duration;
+  return 1;
+}
+
+//***************************************************************************
+//* sim_command()
+//* Input(s) : sim, command written to FMCON.
+//* Returns : none.
+//* Description :
+//***************************************************************************
+static void sim_command(lpc900_sim *sim, unsigned char command)
+{
+  unsigned int mask = sim->flash_size - 1;
+  unsigned int base;
+  unsigned int index;
+  unsigned long crc;
+  sim->fmcon = command;
+  switch(command)
+  {
+    case SIM_LOAD:
+      memset(sim->page_loaded, 0, sizeof(sim->page_loaded));
+      break;
+    case SIM_PROG:
+      if(!sim_start(sim, SIM_TIME_PROG)) break;
+      base = sim->fmadr & mask & ~(SIM_PAGE_SIZE - 1);
+      for(index = 0; index < SIM_PAGE_SIZE; index++)
+      {
+        if(sim->page_loaded[index])				// only loaded bytes are written
+        {
+          sim->flash[base + index] = sim->page[index];
+        }
+      }
+      break;
+    case SIM_ERS_P:
+      if(!sim_start(sim, SIM_TIME_ERS_P)) break;
+      memset(&sim->flash[sim->fmadr & mask & ~(SIM_PAGE_SIZE - 1)], 0xFF, SIM_PAGE_SIZE);
+      break;
+    case SIM_ERS_S:
+      if(!sim_start(sim, SIM_TIME_ERS_S)) break;
+      memset(&sim->flash[sim->fmadr & mask & ~(SIM_SECTOR_SIZE - 1)], 0xFF, SIM_SECTOR_SIZE);
+      break;
+    case SIM_ERS_G:
+      if(!sim_start(sim, SIM_TIME_ERS_G)) break;
+      memset(sim->flash, 0xFF, sim->flash_size);
+      break;
+    case SIM_CRC_S:
+    case SIM_CRC_G:
+      if(command == SIM_CRC_S)
+      {
+        if(!sim_start(sim, SIM_TIME_CRC_S)) break;
+        crc = lpc900_crc(&sim->flash[sim->fmadr & mask & ~(SIM_SECTOR_SIZE - 1)], SIM_SECTOR_SIZE);
+      }
+      else
+      {
+        if(!sim_start(sim, SIM_TIME_CRC_G)) break;
+        crc = lpc900_crc(sim->flash, sim->flash_size);
+      }
+      for(index = 0; index < 4; index++)
+      {
+        sim->crc_bytes[index] = (unsigned char)(crc >> (8 * index));
+      }
+      sim->crc_index = 0;
+      break;
+    case SIM_CCP:
+      sim->ccp_armed = 1;
+      break;
+    default:									// CONF and unknown commands select only
+      break;
+  }
+}
+
+//***************************************************************************
+//* sim_write_data()
+//* Input(s) : sim, value written to FMDATA, step, 1 for the _I/_PG forms.
+//* Returns : none.
+//* Description :
+//***************************************************************************
+static void sim_write_data(lpc900_sim *sim, unsigned char value, unsigned char step)
+{
+  unsigned int offset;
+  if(sim->fmcon == SIM_LOAD)					// into the page register
+  {
+    offset = sim->fmadr & (SIM_PAGE_SIZE - 1);
+    sim->page[offset] = value;
+    sim->page_loaded[offset] = 1;
+    if(step)									// steps within the page only
+    {
+      sim->fmadr = (sim->fmadr & ~(SIM_PAGE_SIZE - 1)) | ((offset + 1) & (SIM_PAGE_SIZE - 1));
+    }
+  }
+  else if(sim->fmcon == SIM_CONF)				// config byte
+  {
+    if(sim_start(sim, SIM_TIME_CONF) && !sim->config_protected)
+    {
+      sim->config[sim->fmadr & (SIM_CONFIG_SIZE - 1)] = value;
+    }
+  }
+  else if((sim->fmcon == SIM_CCP) && sim->ccp_armed)
+  {
+    sim->ccp_armed = 0;
+    if((value == SIM_CLR_CCP_KEY) && sim_start(sim, SIM_TIME_CCP))
+    {
+      sim->config_protected = 0;
+    }
+  }
+}
+
+//***************************************************************************
+//* sim_read()
+//* Input(s) : sim, opcode, an odd one.
+//* Returns : byte the part shifts out.
+//* Description :
+//***************************************************************************
+static unsigned char sim_read(lpc900_sim *sim, unsigned char opcode)
+{
+  unsigned char value = 0xFF;
+  unsigned int mask = sim->flash_size - 1;
+  switch(opcode)
+  {
+    case SIM_RD_FMADRL:
+      value = (unsigned char)sim->fmadr;
+      break;
+    case SIM_RD_FMADRH:
+      value = (unsigned char)(sim->fmadr >> 8);
+      break;
+    case SIM_RD_FMCON:
+      value = sim->status | (lpc900_busy(sim, sim->now) ? SIM_FMCON_BUSY : 0);
+      break;
+    case SIM_RD_FMDATA:
+    case SIM_RD_FMDATA_I:
+    case SIM_RD_FMDATA_PG:
+      if(((sim->fmcon == SIM_CRC_G) || (sim->fmcon == SIM_CRC_S)) && (sim->crc_index < 4))
+      {
+        value = sim->crc_bytes[sim->crc_index];
+        if(opcode != SIM_RD_FMDATA) sim->crc_index++;
+        break;
+      }
+      if(sim->fmcon == SIM_CONF)
+      {
+        value = sim->config[sim->fmadr & (SIM_CONFIG_SIZE - 1)];
+      }
+      else if(!lpc900_busy(sim, sim->now))		// the array can't be read while busy
+      {
+        value = sim->flash[sim->fmadr & mask];
+      }
+      if(opcode != SIM_RD_FMDATA)
+      {
+        sim->fmadr = (sim->fmadr + 1) & 0xFFFF;
+      }
+      break;
+  }
+  return value;
+}
+
+//***************************************************************************
+//* sim_pda()
+//* Input(s) : sim, pda, level the master puts on PDA.
+//* Returns : PDA level on the bus.
+//* Description : a result bit only shows pda_delay after the rising edge,
+//*				before that PDA still has the previous level
+//***************************************************************************
+static unsigned char sim_pda(lpc900_sim *sim, unsigned char pda)
+{
+  if(!sim->driving)
+  {
+    return pda;
+  }
+  if(sim->pcl && (sim->now - sim->last_edge < sim->pda_delay))
+  {
+    return sim->pda_prev;
+  }
+  return sim->pda_out;
+}
+
+//***************************************************************************
+//* sim_byte()
+//* Input(s) : sim, byte clocked in.
+//* Returns : none.
+//* Description : decode opcodes and operands
+//***************************************************************************
+static void sim_byte(lpc900_sim *sim, unsigned char value)
+{
+  sim->bytes_in++;
+  if(!sim->have_opcode)
+  {
+    if(value == SIM_NOP)
+    {
+      return;
+    }
+    if(value & 0x01)							// read, the part answers next
+    {
+      sim->shift = sim_read(sim, value);
+      sim->driving = 1;
+      sim->pda_out = 1;							// PDA was pulled up until now
+      return;
+    }
+    sim->opcode = value;
+    sim->have_opcode = 1;
+    return;
+  }
+  sim->have_opcode = 0;
+  switch(sim->opcode)
+  {
+    case SIM_WR_FMADRL:
+      sim->fmadr = (sim->fmadr & 0xFF00) | value;
+      sim->crc_index = 4;						// FMDATA reads Flash again
+      break;
+    case SIM_WR_FMADRH:
+      sim->fmadr = (sim->fmadr & 0x00FF) | ((unsigned int)value << 8);
+      sim->crc_index = 4;
+      break;
+    case SIM_WR_FMCON:
+      sim_command(sim, value);
+      break;
+    case SIM_WR_FMDATA:
+      sim_write_data(sim, value, 0);
+      break;
+    case SIM_WR_FMDATA_I:
+    case SIM_WR_FMDATA_PG:
+      sim_write_data(sim, value, 1);
+      break;
+  }
+}
+
+//***************************************************************************
+//* lpc900_bus()
+//* Input(s) : sim, now, pcl, pda, levels the master puts on the bus, pda
+//*			is ignored while the part drives it.
+//* Returns : PDA level as the part leaves it, 1 when nobody drives it.
+//* Description : one call per pin change of the master
+//***************************************************************************
+unsigned char lpc900_bus(lpc900_sim *sim, unsigned long long now, unsigned char pcl, unsigned char pda)
+{
+  unsigned char value;
+  sim->now = now;
+  if(!sim->icp || (pcl == sim->pcl))
+  {
+    sim->pcl = pcl;
+    return sim_pda(sim, pda);
+  }
+  sim->edges++;
+  if((sim->edges > 1) && (now - sim->last_edge < SIM_HALF_MIN_NS))
+  {
+    sim->fast_edges++;
+  }
+  if((sim->edges > 1) && (now - sim->last_edge < SIM_GAP_NS))	// part of a transfer
+  {
+    sim->bus_time += now - sim->last_edge;
+    sim->bus_halves++;
+  }
+  sim->last_edge = now;
+  sim->pcl = pcl;
+  if(!pcl)										// falling edge
+  {
+    if(sim->driving == 2)						// last result bit has been sampled
+    {
+      sim->driving = 0;
+      sim->shift = 0;
+    }
+    return sim_pda(sim, pda);
+  }
+  if(sim->driving)								// result bit for the master
+  {
+    sim->pda_prev = sim->pda_out;
+    sim->pda_out = (sim->shift >> sim->bits) & 0x01;
+    if(++sim->bits == 8)
+    {
+      sim->bits = 0;
+      sim->bytes_out++;
+      sim->driving = 2;							// released on the next falling edge
+    }
+    return sim_pda(sim, pda);
+  }
+  sim->shift |= (pda & 0x01) << sim->bits;
+  if(++sim->bits == 8)
+  {
+    sim->bits = 0;
+    value = sim->shift;
+    sim->shift = 0;
+    sim_byte(sim, value);						// a read loads shift with the result
+  }
+  return sim_pda(sim, pda);
+}
@@ -0,0 +1,92 @@
+//***************************************************************************
+//* 								lpc900_sim.h
+//*	Discription : behavioural model of the ICP slave of an LPC9xx, driven
+//*				one PCL/PDA edge at a time so the bridge's own bus code
+//*				can be run and timed on a Linux host
+//***************************************************************************
+#ifndef __LPC900_SIM_H__
+#define __LPC900_SIM_H__
+
+//***************************************************************************
+//* Target settings
+//***************************************************************************
+#define SIM_FLASH_MAX	0x4000		// largest Flash of the family, 16K
+#define SIM_PAGE_SIZE	64			// page register
+#define SIM_SECTOR_SIZE	1024		// bytes erased by ERS_S
+#define SIM_CONFIG_SIZE	32			// config space reached with CONF
+#define SIM_ENTRY_PULSES 7			// RESET pulses that enter ICP mode
+#define SIM_HALF_MIN_NS	100			// shortest PCL half period the part takes
+#define SIM_GAP_NS		10000		// longer PCL half periods are pauses between transfers
+
+//***************************************************************************
+//* Flash command durations in nsec
+//***************************************************************************
+#define SIM_TIME_PROG	2000000UL	// program page register
+#define SIM_TIME_ERS_P	2000000UL	// erase page
+#define SIM_TIME_ERS_S	2000000UL	// erase sector
+#define SIM_TIME_ERS_G	2000000UL	// erase global
+#define SIM_TIME_CRC_S	250000UL	// sector CRC
+#define SIM_TIME_CRC_G	4000000UL	// global CRC, 16K
+#define SIM_TIME_CONF	2000000UL	// write config byte
+#define SIM_TIME_CCP	2000000UL	// clear config protection
+
+#define SIM_FMCON_BUSY	0x80		// FMCON busy bit
+#define SIM_FMCON_OI	0x01		// FMCON operation interrupted, command refused
+
+//***************************************************************************
+//* Model state
+//***************************************************************************
+typedef struct
+{
+  // part
+  unsigned int flash_size;						// bytes of Flash, a power of 2
+  unsigned char flash[SIM_FLASH_MAX];
+  unsigned char config[SIM_CONFIG_SIZE];
+  unsigned char config_protected;				// CCP not cleared yet
+  unsigned char page[SIM_PAGE_SIZE];			// page register
+  unsigned char page_loaded[SIM_PAGE_SIZE];		// page register bytes written since LOAD
+  // registers
+  unsigned int fmadr;							// FMADRH:FMADRL
+  unsigned char fmcon;							// last command written
+  unsigned char status;							// FMCON read back
+  unsigned char crc_bytes[4];					// result of CRC_G/CRC_S, LSB first
+  unsigned char crc_index;						// next CRC byte for RD_FMDATA_I
+  unsigned char ccp_armed;						// CCP written, key expected
+  unsigned long long busy_until;				// time the running command ends
+  // bus
+  unsigned char powered;
+  unsigned char reset;							// RESET pin level
+  unsigned char pulses;							// RESET pulses since power up
+  unsigned char icp;							// in ICP mode
+  unsigned char pcl;							// PCL level
+  unsigned char pda_out;						// level the part drives on PDA
+  unsigned char pda_prev;						// level before the last result bit
+  unsigned long pda_delay;						// nsec from rising PCL to a valid result bit
+  unsigned char driving;						// part drives PDA, 2 after its last bit
+  unsigned char shift;							// byte being shifted
+  unsigned char bits;							// bits shifted so far
+  unsigned char opcode;							// opcode waiting for its operand
+  unsigned char have_opcode;					// next byte is the operand
+  unsigned long long now;						// time of the last edge, nsec
+  unsigned long long last_edge;					// time of the last PCL edge
+  // statistics
+  unsigned long edges;							// PCL edges seen
+  unsigned long bytes_in;						// bytes clocked into the part
+  unsigned long bytes_out;						// bytes clocked out of the part
+  unsigned long fast_edges;						// half periods under SIM_HALF_MIN_NS
+  unsigned long long bus_time;					// nsec of half periods under SIM_GAP_NS
+  unsigned long bus_halves;						// half periods under SIM_GAP_NS
+  unsigned long busy_violations;				// commands given while busy
+} lpc900_sim;
+
+//***************************************************************************
+//* Functions
+//***************************************************************************
+void lpc900_init(lpc900_sim *sim, unsigned int flash_size);
+void lpc900_power(lpc900_sim *sim, unsigned long long now, unsigned char on);
+void lpc900_reset(lpc900_sim *sim, unsigned long long now, unsigned char level);
+unsigned char lpc900_bus(lpc900_sim *sim, unsigned long long now, unsigned char pcl, unsigned char pda);
+unsigned char lpc900_busy(lpc900_sim *sim, unsigned long long now);
+unsigned long lpc900_crc(const unsigned char *data, unsigned int length);
+
+#endif